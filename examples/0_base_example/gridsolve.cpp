@@ -18,7 +18,6 @@ int main( int argc, char* args[] ) {
 	//Construct a Solver
 	Solver<Example> exampleSolver;
 	exampleSolver.setup("Example Solver", example.d, 0.001);
-	exampleSolver.dim = example.d;
 
 	//Set the Integrator Function
 	exampleSolver.integrator = &Example::exampleIntegrator;
@@ -16,7 +16,7 @@ public:
 
   //Initializer and Integrator
   std::vector<CArray> exampleInitialize();
-  std::vector<CArray> exampleIntegrator(std::vector<CArray> &_fields);
+  void exampleIntegrator(std::vector<CArray> &_fields, std::vector<CArray> &_rhs);
 
   /*
   You can have multiple initializers and integrators
@@ -31,7 +31,7 @@ bool Example::setup(){
 //Initializer
 std::vector<CArray> Example::exampleInitialize(){
   //Set the Solver Size!
-  solve::modes = d;
+  solve::bind(d);
 
   //Blank Fields
   std::vector<CArray> fields = solve::emptyArray(1);  //Size of the fields!
@@ -45,13 +45,9 @@ std::vector<CArray> Example::exampleInitialize(){
 }
 
 //Integrator
-std::vector<CArray> Example::exampleIntegrator(std::vector<CArray> &_fields){
-  //Create a new field vector
-  std::vector<CArray> delta = solve::emptyArray(_fields.size());
+void Example::exampleIntegrator(std::vector<CArray> &_fields, std::vector<CArray> &_rhs){
 
   /*
-  Manipulate the deltas or the fields directly!
+  Manipulate the fields directly, or write their time derivative into _rhs!
   */
-
-  return delta;
 }
@@ -21,7 +21,7 @@ public:
 
   //Initializer and Integrator
   std::vector<CArray> exampleInitialize();
-  std::vector<CArray> exampleIntegrator(std::vector<CArray> &_fields);
+  void exampleIntegrator(std::vector<CArray> &_fields, std::vector<CArray> &_rhs);
 
   /*
   You can have multiple initializers and integrators
@@ -38,7 +38,6 @@ public:
 bool Example::setup(){
 	//Setup the Solver
 	solver.setup("Example Solver", d, 0.001);
-	solver.dim = d;
 
 	//Set the Integrator Function
 	solver.integrator = &Example::exampleIntegrator;
@@ -52,7 +51,7 @@ bool Example::setup(){
 //Initializer
 std::vector<CArray> Example::exampleInitialize(){
   //Set the Solver Size!
-  solve::modes = d;
+  solve::bind(d);
 
   //Blank Fields
   std::vector<CArray> fields = solve::emptyArray(1);  //Size of the fields!
@@ -66,18 +65,14 @@ std::vector<CArray> Example::exampleInitialize(){
 }
 
 //Integrator
-std::vector<CArray> Example::exampleIntegrator(std::vector<CArray> &_fields){
-  //Create a new field vector
-  std::vector<CArray> delta = solve::emptyArray(_fields.size());
+void Example::exampleIntegrator(std::vector<CArray> &_fields, std::vector<CArray> &_rhs){
 
   /*
-  Manipulate the deltas or the fields directly!
+  Manipulate the fields directly, or write their time derivative into _rhs!
   */
 
 	//Simply increase it a little bit, so you can see the effect live.
 	_fields[0] += 0.01;	//This adds 0.01 to the entire grid!
-
-  return delta;
 }
 
 /*
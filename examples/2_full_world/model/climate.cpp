@@ -7,7 +7,6 @@ bool Climate::setup(Geology &geology){
 
   //Setup the Solver
   solver.setup("Climate Solver", geology.d, 0.001);
-  solver.dim = geology.d;
   solver.integrator = &Climate::climateIntegrator; //Set the Caller
   solver.fields = climateInitialize();
 
@@ -22,15 +21,15 @@ bool Climate::setup(Geology &geology){
 
 //Initalizer
 
-std::vector<CArray> Climate::climateInitialize(){
+std::vector<RArray> Climate::climateInitialize(){
   //Reset these Values (might have changed)
   d = geologyptr->d;
   sealevel = geologyptr->sealevel;
   SEED = geologyptr->SEED;
 
   //Blank Fields
-  solve::modes = d;
-  std::vector<CArray> fields = solve::emptyArray(6);
+  solve::bind(d);
+  std::vector<RArray> fields = solve::emptyArray<double>(6);
 
   //Perlin Noise Module
   _wind.SetOctaveCount(2);
@@ -54,9 +53,11 @@ std::vector<CArray> Climate::climateInitialize(){
 
 //Integrator: Climate
 
-std::vector<CArray> Climate::climateIntegrator(std::vector<CArray> &_fields){
-  //Create a new field vector
-  std::vector<CArray> delta = solve::emptyArray(_fields.size());
+void Climate::climateIntegrator(std::vector<RArray> &_fields, std::vector<RArray> &_rhs){
+  //Follow the terrain of the geology
+  if(height != NULL){
+    _fields[0] = (*height)();
+  }
 
   //Compute the Wind
   //Shift height by wind direction, form difference and divide by gridsize
@@ -65,55 +66,50 @@ std::vector<CArray> Climate::climateIntegrator(std::vector<CArray> &_fields){
   float theta = 2*3.14159265*_wind.GetValue(dayfrac, SEED, SEED);
   glm::vec2 _winddir = glm::vec2(0.5)*glm::vec2(cos(theta), sin(theta));
   //Get the Windstrength
-  CArray heightproject = solve::roll(_fields[0], glm::floor(glm::vec2(10)*_winddir));
+  RArray heightproject = solve::roll(_fields[0], glm::floor(glm::vec2(10)*_winddir));
   _fields[1] = solve::scale(heightproject - _fields[0], 0.0, 1.0);
 
   //Compute the Temperature Update, by shifting it with the wind
-  _fields[2] = solve::diffuse(_fields[2], 0.0000005, 10);  //Diffuse temperature map
-  CArray ones(1.0, solve::modes.x*solve::modes.y);
-  CArray tempshift = solve::shift(_fields[2], (complex)(10.0*_winddir.x)*_fields[1], (complex)(10.0*_winddir.y)*_fields[1]);
+  solve::diffuse<double>({&_fields[2], &_fields[3]}, 0.0000005, 10);  //Diffuse temperature and humidity map
+  RArray ones(1.0, solve::grid().N);
+  //Temperature, humidity, downfall and clouds are carried by the same wind
+  solve::advection(wind, (double)(10.0*_winddir.x)*_fields[1], (double)(10.0*_winddir.y)*_fields[1]);
+  RArray tempshift = solve::advect(_fields[2], wind);
   _fields[2][tempshift > 0.0] = tempshift[tempshift > 0.0];
-  _fields[2][_fields[0]>sealevel] += ((complex)0.1*solve::scale(_fields[1], -1.0, 1.0))[_fields[0]>sealevel];  //Rising air cools, sinking air heats
-  _fields[2] += ((complex)0.015*((complex)1.2-_fields[5])); //Sunlight on land
-  _fields[2][_fields[0]<sealevel] -= ((complex)0.01*ones)[_fields[0]<sealevel]; //Cooling over the sea, evaporation
-  _fields[2] -= (complex)0.03*_fields[4]; //If its raining, cool down
+  _fields[2][_fields[0]>sealevel] += ((double)0.1*solve::scale(_fields[1], -1.0, 1.0))[_fields[0]>sealevel];  //Rising air cools, sinking air heats
+  _fields[2] += ((double)0.015*((double)1.2-_fields[5])); //Sunlight on land
+  _fields[2][_fields[0]<sealevel] -= ((double)0.01*ones)[_fields[0]<sealevel]; //Cooling over the sea, evaporation
+  _fields[2] -= (double)0.03*_fields[4]; //If its raining, cool down
 
   //Compute the Humidity Map
-  _fields[3] = solve::diffuse(_fields[3], 0.0000005, 10);  //Diffuse temperature map
-  CArray humidshift = solve::shift(_fields[3], (complex)(10.0*_winddir.x)*_fields[1], (complex)(10.0*_winddir.y)*_fields[1]);
+  RArray humidshift = solve::advect(_fields[3], wind);
   _fields[3][humidshift > 0.0] = humidshift[humidshift > 0.0];
-  _fields[3][_fields[0] < sealevel] += (((complex)1.0-_fields[3])*0.05*_fields[2])[_fields[0] < sealevel]; //Over body of water, grow proportional to temperature
-  _fields[3] -= (complex)0.3*_fields[3]*_fields[3]*_fields[4];     //When raining, remove
+  _fields[3][_fields[0] < sealevel] += (((double)1.0-_fields[3])*0.05*_fields[2])[_fields[0] < sealevel]; //Over body of water, grow proportional to temperature
+  _fields[3] -= (double)0.3*_fields[3]*_fields[3]*_fields[4];     //When raining, remove
 
   //Downfall condition
-  CArray downfallshift = solve::shift(_fields[4], (complex)(10.0*_winddir.x)*_fields[1], (complex)(10.0*_winddir.y)*_fields[1]);
+  RArray downfallshift = solve::advect(_fields[4], wind);
   _fields[4][downfallshift > 0.0] = downfallshift[downfallshift > 0.0];
-  CArray _test = (complex)0.56+(complex)0.25*_fields[2]; //If temperature is zero, moisture freezes
-  _fields[4][_fields[3] > _test] += ((complex)0.007*ones)[_fields[3] > _test];
-  _fields[4][_fields[3] < _test] -= ((complex)0.07*ones)[_fields[3] < _test];
+  RArray _test = (double)0.56+(double)0.25*_fields[2]; //If temperature is zero, moisture freezes
+  _fields[4][_fields[3] > _test] += ((double)0.007*ones)[_fields[3] > _test];
+  _fields[4][_fields[3] < _test] -= ((double)0.07*ones)[_fields[3] < _test];
 
   //Cloud Condition
-  CArray cloudshift = solve::shift(_fields[5], (complex)(10.0*_winddir.x)*_fields[1], (complex)(10.0*_winddir.y)*_fields[1]);
+  RArray cloudshift = solve::advect(_fields[5], wind);
   _fields[5][cloudshift > 0.0] = cloudshift[cloudshift > 0.0];
-  _test = (complex)0.54+(complex)0.23*_fields[2];
-  _fields[5][_fields[3] > _test] += ((complex)0.007*ones)[_fields[3] > _test];
-  _fields[5][_fields[3] < _test] -= ((complex)0.3*ones)[_fields[3] < _test];
+  _test = (double)0.54+(double)0.23*_fields[2];
+  _fields[5][_fields[3] > _test] += ((double)0.007*ones)[_fields[3] > _test];
+  _fields[5][_fields[3] < _test] -= ((double)0.3*ones)[_fields[3] < _test];
 
   //Clamp the Quantities
   _fields[2] = solve::clamp(_fields[2], 0.0, 1.0);
   _fields[3] = solve::clamp(_fields[3], 0.0, 1.0);
   _fields[4] = solve::clamp(_fields[4], 0.0, 1.0);
   _fields[5] = solve::clamp(_fields[5], 0.0, 1.0);
-
-  return delta;
 }
 
 //Integrator: Erosion
 
-std::vector<CArray> Climate::erosionIntegrator(std::vector<CArray> &_fields){
-  //Create a new field vector
-  std::vector<CArray> delta= solve::emptyArray(_fields.size());
+void Climate::erosionIntegrator(std::vector<RArray> &_fields, std::vector<RArray> &_rhs){
   std::cout<<"Erosion Integrator!"<<std::endl;
-
-  return delta;
 }
@@ -13,13 +13,17 @@ public:
 
   //Setter Upper
   Geology* geologyptr;  //Pointer the the geology class (we need this!)
+  const solve::Snapshot<double>* height = NULL;  //Geology height of the last tick (when scheduled together)
   bool setup(Geology &geology);
 
   //Field Initializers and Integrators
-  Solver<Climate> solver;
-  std::vector<CArray> climateInitialize();
-  std::vector<CArray> climateIntegrator(std::vector<CArray> &_fields);
-  std::vector<CArray> erosionIntegrator(std::vector<CArray> &_fields);
+  Solver<Climate, double> solver;
+  std::vector<RArray> climateInitialize();
+  void climateIntegrator(std::vector<RArray> &_fields, std::vector<RArray> &_rhs);
+  void erosionIntegrator(std::vector<RArray> &_fields, std::vector<RArray> &_rhs);
+
+  //Where the wind carries the fields from (rebuilt every step)
+  solve::Advection wind;
 };
 
 /*
@@ -32,10 +36,10 @@ template<>
 SDL_Surface* View::getSurface<Climate>(Climate &climate){
   //Here we want to actually draw whatever the current selected field is.
   //Array for the Color
-  CArray R(0.0, climate.d.x*climate.d.y);
-  CArray G(0.0, climate.d.x*climate.d.y);
-  CArray B(0.0, climate.d.x*climate.d.y);
-  CArray A(255.0, climate.d.x*climate.d.y);
+  RArray R(0.0, climate.d.x*climate.d.y);
+  RArray G(0.0, climate.d.x*climate.d.y);
+  RArray B(0.0, climate.d.x*climate.d.y);
+  RArray A(255.0, climate.d.x*climate.d.y);
 
   //Switch the Current Field
   switch(curField){
@@ -50,20 +54,20 @@ SDL_Surface* View::getSurface<Climate>(Climate &climate){
       B[test] = view::gradC(68, 138, climate.solver.fields[0])[test];
 
       //Add the downfall overlay
-      R *= ((complex)1.0-climate.solver.fields[4]);
-      G *= ((complex)1.0-climate.solver.fields[4]);
-      B *= ((complex)1.0-climate.solver.fields[4]);
-      R += ((complex)0*climate.solver.fields[4]);
-      G += ((complex)0*climate.solver.fields[4]);
-      B += ((complex)0*climate.solver.fields[4]);
+      R *= ((double)1.0-climate.solver.fields[4]);
+      G *= ((double)1.0-climate.solver.fields[4]);
+      B *= ((double)1.0-climate.solver.fields[4]);
+      R += ((double)0*climate.solver.fields[4]);
+      G += ((double)0*climate.solver.fields[4]);
+      B += ((double)0*climate.solver.fields[4]);
 
       //Add the cloud overlay
-      R *= ((complex)1.0-climate.solver.fields[5]);
-      G *= ((complex)1.0-climate.solver.fields[5]);
-      B *= ((complex)1.0-climate.solver.fields[5]);
-      R += ((complex)255*climate.solver.fields[5]);
-      G += ((complex)255*climate.solver.fields[5]);
-      B += ((complex)255*climate.solver.fields[5]);
+      R *= ((double)1.0-climate.solver.fields[5]);
+      G *= ((double)1.0-climate.solver.fields[5]);
+      B *= ((double)1.0-climate.solver.fields[5]);
+      R += ((double)255*climate.solver.fields[5]);
+      G += ((double)255*climate.solver.fields[5]);
+      B += ((double)255*climate.solver.fields[5]);
 
       break;}
     case 1:{ //Wind
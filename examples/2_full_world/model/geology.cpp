@@ -3,7 +3,6 @@
 bool Geology::setup(){
   //Setup the Solver
   solver.setup("Geology Solver", d, 0.001);
-  solver.dim = d;
   solver.integrator = &Geology::geologyIntegrator;
   solver.fields = geologyInitialize();
 
@@ -18,16 +17,13 @@ bool Geology::setup(){
 
 //Initializer
 
-std::vector<CArray> Geology::geologyInitialize(){
-  //Reset the Seed
-  srand(SEED);
-
+std::vector<RArray> Geology::geologyInitialize(){
   //Blank Fields
-  solve::modes = d;
-  std::vector<CArray> fields = solve::emptyArray(3);
+  solve::bind(d);
+  std::vector<RArray> fields = solve::emptyArray<double>(3);
 
   //Set the Initial Value
-  fields[2] = (complex)0.4;
+  fields[2] = 0.4;
 
   //Perlin Noise Module
   noise::module::Perlin perlin;
@@ -38,13 +34,13 @@ std::vector<CArray> Geology::geologyInitialize(){
   noise::module::Voronoi voronoi;
   voronoi.SetFrequency(8);
 
-  float a = (float)(rand()%SEED)/((SEED));
+  //Volcanism and the voronoi slice only depend on the seed
+  float a = solve::Philox(SEED, 1).uniform(0);
+  fields[0] = solve::uniform<double>(SEED);
 
   //Seed the Maps
   for(int i = 0; i < d.x; i++){
     for(int j = 0; j < d.y; j++){
-      //Generate a Volcanism Value
-      fields[0][i*(int)d.y+j] = (float)(rand()%SEED)/(SEED);
       fields[1][i*(int)d.y+j] = ((voronoi.GetValue((float)i/d.x, (float)j/d.y, a)));
       fields[2][i*(int)d.y+j] = 0.4;
     }
@@ -54,75 +50,90 @@ std::vector<CArray> Geology::geologyInitialize(){
   return fields;
 }
 
-//Integrator
-std::vector<CArray> Geology::geologyIntegrator(std::vector<CArray> &_fields){
-  //Create a new field vector
-  std::vector<CArray> delta = solve::emptyArray(_fields.size());
+//Coarse-to-Fine Generation
+void Geology::coarseToFine(int steps, double timeStep){
+  solve::Pipeline<Geology, double> pipeline;
+  pipeline.sampling = {solve::BICUBIC, solve::NEAREST, solve::BICUBIC};   //Plates are labels
+  pipeline.add(d/glm::vec2(4), steps, timeStep);
+  pipeline.add(d/glm::vec2(2), steps/4, timeStep);
+  pipeline.add(d, steps/16, timeStep);
+
+  Solver<Geology, double> &finest = pipeline.run(*this, geologyInitialize(), d, &Geology::geologyIntegrator, &Solver<Geology, double>::EE);
+  solver.fields = finest.fields;
+  solver.time = finest.time;
+}
 
-  //Label for all plates, and number of clusters
-  int nlabels = 0;
+//Integrator
+void Geology::geologyIntegrator(std::vector<RArray> &_fields, std::vector<RArray> &_rhs){
+  //Label the connected plates
+  std::vector<solve::Component> plates;
+  IArray label = solve::components(_fields[1], plates);
+  int nlabels = plates.size();
+
+  //Volcanism and Height are transformed together, gradients and diffusion reuse the spectra
+  solve::Field<double> volcanism(_fields[0]);
+  solve::Field<double> height(_fields[2]);
+  solve::spectral<double>({&volcanism, &height});
+
+  solve::Field<double> dx = solve::diff(volcanism, 1, 0);
+  solve::Field<double> dy = solve::diff(volcanism, 0, 1);
+  solve::diffuse(volcanism, 0.0000001, 10);
+  solve::diffuse(height, 0.00000005, 10);   //Diffuse Height
+  solve::physical<double>({&dx, &dy, &volcanism, &height});
 
-  CArray label = solve::label(_fields[1], nlabels);
   //Compute the Force Vectors
-  CArray gradx = solve::scale(solve::diff(_fields[0], 1, 0), -1.0, 1.0);  //Gradient of the Volcanism Map
-  CArray grady = solve::scale(solve::diff(_fields[0], 0, 1), -1.0, 1.0);  //Gradient of the Volcanism Map
+  RArray gradx = solve::scale(dx.physical(), -1.0, 1.0);  //Gradient of the Volcanism Map
+  RArray grady = solve::scale(dy.physical(), -1.0, 1.0);  //Gradient of the Volcanism Map
 
-  //New Plate Arrary
-  CArray overlap(-1.0, solve::modes.x*solve::modes.y);
-  CArray winner(0.0, solve::modes.x*solve::modes.y);
-  CArray newplate(0.0, solve::modes.x*solve::modes.y);        //New Plate Configuration is empty
+  //Mean force on every plate, all plates in one sweep
+  solve::Reduction<double> forces = solve::reduceByLabel<double>(label, nlabels, {&gradx, &grady});
 
-  //Loop over all cluster labels
+  //Plates move 10 cells per step at the full size d, coarse levels (coarseToFine)
+  //move them by as many of their larger cells. Diffusion and the rates below are
+  //per area and step already, they are the same on every level.
+  glm::vec2 scale = solve::grid().modes/d;
+  std::vector<glm::vec2> shift(nlabels);
   for(int i = 0; i < nlabels; i++){
-    //Mask the force array with
-    CArray forcex(0.0, solve::modes.x*solve::modes.y);
-    CArray forcey(0.0, solve::modes.x*solve::modes.y);
-    BArray test = label == (complex)i;
-    CArray ones(1.0, solve::modes.x*solve::modes.y);
-    forcex[test] = gradx[test];
-    forcey[test] = grady[test];
-    glm::vec2 force = glm::vec2(forcex.sum().real(), forcey.sum().real());
-    //Normalize the Force Vector
-    forcex[test] = 1.0;
-    forcey[test] = 1.0;
-    force /= glm::vec2(forcex.sum().real(), forcey.sum().real());
-    //Get the Label Mask
-    CArray projected(0.0, solve::modes.x*solve::modes.y);
-    projected[test] = _fields[1][test];
-
-    //Roll it a bit
-    glm::vec2 shift = glm::round((force)*glm::vec2(10));
-    projected = solve::roll(projected, shift);
-
-    //Overlap increments everywhere where we project, so where projected isn't 0
-    overlap[projected > 0.0] += ones[projected > 0.0];
+    glm::vec2 force = glm::vec2(forces.sum[0][i], forces.sum[1][i]);
+    force /= glm::vec2(forces.count[i]);
+    shift[i] = glm::round((force)*glm::vec2(10)*scale);
+  }
+
+  //New Plate Arrary
+  RArray overlap(-1.0, solve::grid().N);
+  RArray winner(0.0, solve::grid().N);
+
+  //Move every plate cell by the shift of its plate
+  for(int j = 0; j < solve::grid().N; j++){
+    if(_fields[1][j] <= 0.0) continue;
+    int target = solve::ind(solve::pos(j) - shift[label[j]]);
+
+    //Overlap increments everywhere where we project
+    overlap[target] += 1.0;
 
     //Winner is whichever is larger, projection or winner
-    BArray b = projected > winner;
-    winner[b] = projected[b];
+    if(_fields[1][j] > winner[target]) winner[target] = _fields[1][j];
   }
 
   winner[winner == 0.0] += _fields[1][winner == 0.0];
 
   //Diffuse
-  //CArray volcdiff = solve::fft(_fields[0]);
-  //delta[0] = (complex)0.00005*solve::ifft(solve::fdiff(volcdiff, 2, 0) + solve::fdiff(volcdiff, 0, 2));
-  _fields[0] = solve::diffuse(_fields[0], 0.0000001, 10);
+  //RArray volcdiff = solve::fft(_fields[0]);
+  //_rhs[0] = (double)0.00005*solve::ifft(solve::fdiff(volcdiff, 2, 0) + solve::fdiff(volcdiff, 0, 2));
+  _fields[0] = volcanism.physical();
   _fields[1] = winner;
-  _fields[2] = solve::diffuse(_fields[2], 0.00000005, 10);  //Diffuse Height
+  _fields[2] = height.physical();
 
   //Height
-  CArray activity = ((complex)1.0-_fields[1])*_fields[0]; //Activity is 1- Plate Density times volcanism
-  CArray hotspot(0.0, solve::modes.x*solve::modes.y);
+  RArray activity = ((double)1.0-_fields[1])*_fields[0]; //Activity is 1- Plate Density times volcanism
+  RArray hotspot(0.0, solve::grid().N);
   hotspot[activity > 0.7] = 1.0;
 
   //Add the Overlap
-  delta[0] += (complex)100.0*overlap*_fields[2];
+  _rhs[0] += (double)100.0*overlap*_fields[2];
 
   //Add the Overlap to Height
-  delta[2] += (complex)50.0*overlap;
-  delta[2] += (complex)10.0*activity;
-  delta[2] += (complex)30.0*hotspot;
-
-  return delta;
+  _rhs[2] += (double)50.0*overlap;
+  _rhs[2] += (double)10.0*activity;
+  _rhs[2] += (double)30.0*hotspot;
 }
@@ -13,9 +13,12 @@ public:
   bool setup();
 
   //Field Initializers and Integrators
-  Solver<Geology> solver;
-  std::vector<CArray> geologyInitialize();                              //Returns intial fields
-  std::vector<CArray> geologyIntegrator(std::vector<CArray> &_fields);  //Returns time-stepped fields
+  Solver<Geology, double> solver;
+  std::vector<RArray> geologyInitialize();                              //Returns intial fields
+  void geologyIntegrator(std::vector<RArray> &_fields, std::vector<RArray> &_rhs);  //Writes the time derivative
+
+  //Runs most of the steps on coarser grids, then continues on the full one
+  void coarseToFine(int steps, double timeStep);
 };
 
 /*
@@ -27,10 +30,10 @@ public:
 template<>
 SDL_Surface* View::getSurface<Geology>(Geology &geology){
   //Array for the Color
-  CArray R(0.0, geology.d.x*geology.d.y);
-  CArray G(0.0, geology.d.x*geology.d.y);
-  CArray B(0.0, geology.d.x*geology.d.y);
-  CArray A(255.0, geology.d.x*geology.d.y);
+  RArray R(0.0, geology.d.x*geology.d.y);
+  RArray G(0.0, geology.d.x*geology.d.y);
+  RArray B(0.0, geology.d.x*geology.d.y);
+  RArray A(255.0, geology.d.x*geology.d.y);
 
   //Switch the Current Field
   switch(curField){
@@ -134,6 +137,10 @@ void Interface::drawModel<Geology>(View &view, Geology &geology){
   if (ImGui::Button("Stop")){
     geology.solver.steps = 0;
   }
+  if (ImGui::Button("Coarse to Fine")){
+    geology.coarseToFine(timeSteps, f2);
+    geology.solver.updateFields = true;
+  }
 
   ImGui::TextUnformatted("Fields");
 
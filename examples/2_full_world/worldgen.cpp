@@ -30,6 +30,12 @@ int main( int argc, char* args[] ) {
 		return 0;
 	}
 
+	//Climate steps next to Geology and sees its height of the last tick
+	solve::Scheduler scheduler;
+	scheduler.add(geology, geology.solver, &Solver<Geology, double>::EE);
+	int cli = scheduler.add(climate, climate.solver, &Solver<Climate, double>::DIRECT);
+	climate.height = &scheduler.reads(cli, geology.solver, 2);
+
 	//Add the Models
 	view.models.push_back("Geology");
 	view.models.push_back("Climate");
@@ -59,9 +65,8 @@ int main( int argc, char* args[] ) {
 			view.render<Climate>(climate);
 		}
 
-		//Perform the Integration (one step per tick!) for both models
-		geology.solver.step(geology, &Solver<Geology>::EE);
-		climate.solver.step(climate, &Solver<Climate>::DIRECT);
+		//Perform the Integration (one step per tick!) for both models at once
+		scheduler.step();
 	}
 
 	//Clean up
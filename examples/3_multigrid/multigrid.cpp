@@ -0,0 +1,61 @@
+/*
+Multigrid Test
+
+Solves problems with a known solution on grids that are not powers of two
+(odd sizes and elongated grids), for every boundary. Returns 1 if any of them
+does not converge or misses the solution.
+*/
+
+//Stuff
+#include <stdlib.h>
+#include <iostream>
+
+//Solver
+#include "../../source/solver/solver.h"
+
+//Solution with the boundary condition, and its laplacian
+double exact(solve::Boundary boundary, double x, double y){
+	if(boundary == solve::PERIODIC) return std::sin(2.0*PI*x)*std::cos(2.0*PI*y);
+	if(boundary == solve::DIRICHLET) return std::sin(PI*x)*std::sin(PI*y);
+	return std::cos(PI*x)*std::cos(2.0*PI*y);
+}
+
+double eigenvalue(solve::Boundary boundary){
+	if(boundary == solve::PERIODIC) return -8.0*PI*PI;
+	if(boundary == solve::DIRICHLET) return -2.0*PI*PI;
+	return -5.0*PI*PI;
+}
+
+//Solve (alpha - beta*laplace) u = f, the error is second order in the cell size
+bool check(glm::vec2 dim, solve::Boundary boundary, double alpha, double beta){
+	solve::bind(dim);
+	int N = dim.x*dim.y;
+
+	RArray u(0.0, N), f(0.0, N);
+	for(int i = 0; i < N; i++){
+		glm::vec2 p = solve::pos(i);
+		u[i] = exact(boundary, (p.x+0.5)/dim.x, (p.y+0.5)/dim.y);
+		f[i] = (alpha - beta*eigenvalue(boundary))*u[i];
+	}
+
+	solve::Multigrid<double> mg(boundary, alpha, beta);
+	RArray v = mg.solve(f);
+
+	double error = abs(v-u).max();
+	double h = 1.0/std::min(dim.x, dim.y);
+	bool pass = mg.residual <= mg.tolerance && mg.iterations <= 10 && error < 10.0*h*h;
+
+	std::cout<<(pass?"Passed ":"FAILED ")<<dim.x<<"x"<<dim.y<<" (boundary "<<boundary<<", alpha "<<alpha<<"): ";
+	std::cout<<mg.iterations<<" cycles, residual "<<mg.residual<<", error "<<error<<std::endl;
+	return pass;
+}
+
+int main( int argc, char* args[] ) {
+	bool pass = true;
+	for(glm::vec2 dim: {glm::vec2(255, 255), glm::vec2(250, 97), glm::vec2(97, 250), glm::vec2(301, 17), glm::vec2(7, 9)})
+	for(solve::Boundary boundary: {solve::PERIODIC, solve::DIRICHLET, solve::NEUMANN}){
+		pass = check(dim, boundary, 0.0, -1.0) && pass;
+		pass = check(dim, boundary, 1.0, 0.01) && pass;
+	}
+	return pass?0:1;
+}
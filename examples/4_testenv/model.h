@@ -17,7 +17,11 @@ public:
 
   //Initializer and Integrator
   std::vector<CArray> exampleInitialize();
-  std::vector<CArray> exampleIntegrator(std::vector<CArray> &_fields);
+  void exampleIntegrator(std::vector<CArray> &_fields, std::vector<CArray> &_rhs);
+
+	//Binomial kernels (kept, so they are only prepared once)
+	solve::Kernel<complex> kernel1 = solve::Kernel<complex>({0.0625, 0.125, 0.0625, 0.125, 0.25, 0.125, 0.0625, 0.125, 0.0625}, glm::vec2(3));
+	solve::Kernel<complex> kernel2 = solve::Kernel<complex>({0.0, 0.125, 0.0, 0.125, 0.5, 0.125, 0.0, 0.125, 0.0}, glm::vec2(3));
 };
 
 /*
@@ -29,7 +33,6 @@ public:
 bool Example::setup(){
 	//Setup the Solver
 	solver.setup("Example Solver", d, 0.001);
-	solver.dim = d;
 
 	//Set the Integrator Function
 	solver.integrator = &Example::exampleIntegrator;
@@ -43,7 +46,7 @@ bool Example::setup(){
 //Initializer
 std::vector<CArray> Example::exampleInitialize(){
   //Set the Solver Size!
-  solve::modes = d;
+  solve::bind(d);
 
   //Blank Fields
   std::vector<CArray> fields = solve::emptyArray(2);  //Size of the fields!
@@ -57,16 +60,10 @@ std::vector<CArray> Example::exampleInitialize(){
 }
 
 //Integrator
-std::vector<CArray> Example::exampleIntegrator(std::vector<CArray> &_fields){
-  //Create a new field vector
-  std::vector<CArray> delta = solve::emptyArray(_fields.size());
+void Example::exampleIntegrator(std::vector<CArray> &_fields, std::vector<CArray> &_rhs){
 
 	//Do a kernel convolution using a binomial kernel
-	CArray kernel1 = {0.0625, 0.125, 0.0625, 0.125, 0.25, 0.125, 0.0625, 0.125, 0.0625};
-	CArray kernel2 = {0.0, 0.125, 0.0, 0.125, 0.5, 0.125, 0.0, 0.125, 0.0};
-	_fields[0] = solve::convolve(_fields[0], kernel2, glm::vec2(3));
-
-  return delta;
+	_fields[0] = solve::convolve(_fields[0], kernel2);
 }
 
 /*
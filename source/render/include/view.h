@@ -51,25 +51,28 @@ class View{
 namespace view{
 
 //Construct Surface from Color Array
-SDL_Surface* makeSurface(glm::vec2 d, CArray R, CArray G, CArray B, CArray A);
+template<typename T> SDL_Surface* makeSurface(glm::vec2 d, Array<T> R, Array<T> G, Array<T> B, Array<T> A);
 
 //Extract Color Arrays
-CArray gradC(double c1, double c2, CArray field);
-void gradRGB(glm::vec3 c1, glm::vec3 c2, CArray field, CArray &R, CArray &G, CArray &B);
+template<typename T> Array<T> gradC(double c1, double c2, Array<T> field);
+template<typename T> void gradRGB(glm::vec3 c1, glm::vec3 c2, Array<T> field, Array<T> &R, Array<T> &G, Array<T> &B);
 
-CArray gradC(double c1, double c2, CArray field){
-  return field*(complex)c2+((complex)1.0-field)*(complex)c1;
+template<typename T>
+Array<T> gradC(double c1, double c2, Array<T> field){
+  return field*(T)c2+((T)1.0-field)*(T)c1;
 }
 
-void gradRGB(glm::vec3 c1, glm::vec3 c2, CArray field, CArray &R, CArray &G, CArray &B){
+template<typename T>
+void gradRGB(glm::vec3 c1, glm::vec3 c2, Array<T> field, Array<T> &R, Array<T> &G, Array<T> &B){
   //Gradient RGB between two colors
-  R = field*(complex)c2.x+((complex)1.0-field)*(complex)c1.x;
-  G = field*(complex)c2.y+((complex)1.0-field)*(complex)c1.y;
-  B = field*(complex)c2.z+((complex)1.0-field)*(complex)c1.z;
+  R = field*(T)c2.x+((T)1.0-field)*(T)c1.x;
+  G = field*(T)c2.y+((T)1.0-field)*(T)c1.y;
+  B = field*(T)c2.z+((T)1.0-field)*(T)c1.z;
 }
 
 //Define the color
-SDL_Surface* makeSurface(glm::vec2 d, CArray R, CArray G, CArray B, CArray A){
+template<typename T>
+SDL_Surface* makeSurface(glm::vec2 d, Array<T> R, Array<T> G, Array<T> B, Array<T> A){
   //Construct and Return the Surface
   SDL_Surface *s = SDL_CreateRGBSurface(0, d.x, d.y, 32, 0, 0, 0, 0);
   SDL_LockSurface(s);
@@ -79,10 +82,10 @@ SDL_Surface* makeSurface(glm::vec2 d, CArray R, CArray G, CArray B, CArray A){
 
   for(int i = 0; i < d.x*d.y; i++){
     //Raw Pointer Stuff
-    *(img_raw+4*i)    = (unsigned char)R[i].real();
-    *(img_raw+4*i+1)  = (unsigned char)G[i].real();
-    *(img_raw+4*i+2)  = (unsigned char)B[i].real();
-    *(img_raw+4*i+3)  = (unsigned char)A[i].real();
+    *(img_raw+4*i)    = (unsigned char)std::real(R[i]);
+    *(img_raw+4*i+1)  = (unsigned char)std::real(G[i]);
+    *(img_raw+4*i+2)  = (unsigned char)std::real(B[i]);
+    *(img_raw+4*i+3)  = (unsigned char)std::real(A[i]);
   }
 
   SDL_UnlockSurface(s);
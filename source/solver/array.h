@@ -0,0 +1,427 @@
+#include <cstddef>
+#include <memory>
+#include <initializer_list>
+#include <algorithm>
+#include <cmath>
+
+/*
+================================================================================
+                          Expression Template Arrays
+================================================================================
+*/
+
+//Grid storage with lazy arithmetic. An expression like a*(1.0-b)+c only builds
+//a small tree of references, which is evaluated element by element when it is
+//assigned. The whole right-hand side is one loop without intermediate grids.
+//The interface follows std::valarray, including boolean masking.
+
+//Elements compare with ==, unless there is a better overload (see complex)
+template<typename A, typename B> bool equal(const A &a, const B &b){ return a == b; }
+
+namespace lazy{
+
+template<typename T> class Array;
+template<typename E, typename M> struct Compact;
+
+//Base of everything that can be evaluated element-wise
+template<typename D>
+struct Expr{
+  const D& self() const { return static_cast<const D&>(*this); }
+  size_t size() const { return self().size(); }
+
+  //Reductions
+  auto sum() const;
+  auto max() const;
+  auto min() const;
+};
+
+//Arrays are held by reference in expressions, everything else by value
+template<typename E> struct Leaf{ typedef const E type; };
+template<typename T> struct Leaf<Array<T>>{ typedef const Array<T>& type; };
+
+//Scalar operand, broadcast to the size of the other side
+template<typename T>
+struct Constant: Expr<Constant<T>>{
+  typedef T value_type;
+  Constant(const T &_v, size_t _n):v(_v),n(_n){}
+  T operator[](size_t) const { return v; }
+  size_t size() const { return n; }
+  T v;
+  size_t n;
+};
+
+template<typename Op, typename A>
+struct Unary: Expr<Unary<Op, A>>{
+  typedef typename std::decay<decltype(Op()(std::declval<typename A::value_type>()))>::type value_type;
+  Unary(const A &_a):a(_a){}
+  value_type operator[](size_t i) const { return Op()(a[i]); }
+  template<typename M> Compact<Unary, M> operator[](const Expr<M> &m) const { return Compact<Unary, M>(*this, m.self()); }
+  size_t size() const { return a.size(); }
+  typename Leaf<A>::type a;
+};
+
+template<typename Op, typename L, typename R>
+struct Binary: Expr<Binary<Op, L, R>>{
+  typedef typename std::decay<decltype(Op()(std::declval<typename L::value_type>(), std::declval<typename R::value_type>()))>::type value_type;
+  Binary(const L &_l, const R &_r):l(_l),r(_r){}
+  value_type operator[](size_t i) const { return Op()(l[i], r[i]); }
+  template<typename M> Compact<Binary, M> operator[](const Expr<M> &m) const { return Compact<Binary, M>(*this, m.self()); }
+  size_t size() const { return l.size(); }
+  typename Leaf<L>::type l;
+  typename Leaf<R>::type r;
+};
+
+//Elements of an expression where a mask is set (e.g. a[a > 0.0]), read in order
+template<typename E, typename M>
+struct Compact{
+  typedef typename E::value_type value_type;
+  Compact(const E &_e, const M &_m):e(_e),m(_m){}
+  size_t next(size_t i) const { while(i < m.size() && !m[i]) i++; return i; }   //First selected index from i
+  value_type value(size_t i) const { return e[i]; }
+  size_t end() const { return m.size(); }
+  size_t size() const { size_t n = 0; for(size_t i = next(0); i < end(); i = next(i+1)) n++; return n; }
+  typename Leaf<E>::type e;
+  typename Leaf<M>::type m;
+};
+
+//Unmasked sources of a masked assignment are read in order as well
+template<typename E>
+struct Dense{
+  typedef typename E::value_type value_type;
+  Dense(const E &_e):e(_e){}
+  size_t next(size_t i) const { return i; }
+  value_type value(size_t i) const { return e[i]; }
+  size_t end() const { return e.size(); }
+  const E &e;
+};
+
+template<typename T>
+struct Fill{
+  typedef T value_type;
+  Fill(const T &_v):v(_v){}
+  size_t next(size_t i) const { return i; }
+  T value(size_t) const { return v; }
+  size_t end() const { return (size_t)-1; }
+  T v;
+};
+
+//Assignment Operations
+struct Assign{ template<typename A, typename B> void operator()(A &a, const B &b) const { a = b; } };
+struct AddAssign{ template<typename A, typename B> void operator()(A &a, const B &b) const { a += b; } };
+struct SubAssign{ template<typename A, typename B> void operator()(A &a, const B &b) const { a -= b; } };
+struct MulAssign{ template<typename A, typename B> void operator()(A &a, const B &b) const { a *= b; } };
+struct DivAssign{ template<typename A, typename B> void operator()(A &a, const B &b) const { a /= b; } };
+
+//Masked part of an array, as an assignment target (e.g. a[a > 0.0] = 1.0)
+template<typename T, typename M>
+struct MaskRef{
+  MaskRef(Array<T> &_a, const M &_m):a(_a),m(_m){}
+
+  void operator=(const MaskRef &source){ update<Assign>(cursor(source)); }
+  template<typename S> void operator=(const S &source){ update<Assign>(cursor(source)); }
+  template<typename S> void operator+=(const S &source){ update<AddAssign>(cursor(source)); }
+  template<typename S> void operator-=(const S &source){ update<SubAssign>(cursor(source)); }
+  template<typename S> void operator*=(const S &source){ update<MulAssign>(cursor(source)); }
+  template<typename S> void operator/=(const S &source){ update<DivAssign>(cursor(source)); }
+
+  //Two cursors: the i-th selected element gets the i-th element of the source
+  template<typename Op, typename S>
+  void update(const S &source){
+    size_t j = source.next(0);
+    for(size_t i = next(0); i < a.size() && j < source.end(); i = next(i+1), j = source.next(j+1)){
+      Op()(a[i], (T)source.value(j));
+    }
+  }
+
+  //Also a source for other masked assignments (e.g. a[m] = b[m])
+  size_t next(size_t i) const { while(i < m.size() && !m[i]) i++; return i; }
+  T value(size_t i) const { return a[i]; }
+  size_t end() const { return m.size(); }
+
+  template<typename E, typename N> const Compact<E, N>& cursor(const Compact<E, N> &c) const { return c; }
+  template<typename U, typename N> const MaskRef<U, N>& cursor(const MaskRef<U, N> &r) const { return r; }
+  template<typename E> Dense<E> cursor(const Expr<E> &e) const { return Dense<E>(e.self()); }
+  Fill<T> cursor(const T &v) const { return Fill<T>(v); }
+
+  Array<T> &a;
+  typename Leaf<M>::type m;
+};
+
+/*
+================================================================================
+                                 Array Class
+================================================================================
+*/
+
+template<typename T>
+class Array: public Expr<Array<T>>{
+public:
+  typedef T value_type;
+
+  //Construction (same as std::valarray)
+  Array(){}
+  explicit Array(size_t n);
+  Array(const T &v, size_t n);
+  Array(std::initializer_list<T> list);
+  Array(const Array &other);
+  Array(Array &&other);
+  template<typename E> Array(const Expr<E> &e);
+  template<typename E, typename M> Array(const Compact<E, M> &c);
+  template<typename M> Array(const MaskRef<T, M> &r);
+
+  //Assignment evaluates the expression in one pass
+  Array& operator=(const Array &other);
+  Array& operator=(Array &&other);
+  Array& operator=(const T &v);
+  template<typename E> Array& operator=(const Expr<E> &e);
+  template<typename E, typename M> Array& operator=(const Compact<E, M> &c){ return compact(c); }
+  template<typename M> Array& operator=(const MaskRef<T, M> &r){ return compact(r); }
+
+  template<typename E> Array& operator+=(const Expr<E> &e){ return update<AddAssign>(e.self()); }
+  template<typename E> Array& operator-=(const Expr<E> &e){ return update<SubAssign>(e.self()); }
+  template<typename E> Array& operator*=(const Expr<E> &e){ return update<MulAssign>(e.self()); }
+  template<typename E> Array& operator/=(const Expr<E> &e){ return update<DivAssign>(e.self()); }
+  Array& operator+=(const T &v){ return update<AddAssign>(Constant<T>(v, n)); }
+  Array& operator-=(const T &v){ return update<SubAssign>(Constant<T>(v, n)); }
+  Array& operator*=(const T &v){ return update<MulAssign>(Constant<T>(v, n)); }
+  Array& operator/=(const T &v){ return update<DivAssign>(Constant<T>(v, n)); }
+
+  //Element Access
+  T& operator[](size_t i){ return data[i]; }
+  const T& operator[](size_t i) const { return data[i]; }
+  size_t size() const { return n; }
+  void resize(size_t _n, T v = T());
+  T* begin(){ return data.get(); }
+  T* end(){ return data.get()+n; }
+  const T* begin() const { return data.get(); }
+  const T* end() const { return data.get()+n; }
+
+  //Masking (lazy, the mask is evaluated while assigning)
+  template<typename M> MaskRef<T, M> operator[](const Expr<M> &m) &{ return MaskRef<T, M>(*this, m.self()); }
+  template<typename M> Compact<Array, M> operator[](const Expr<M> &m) const &{ return Compact<Array, M>(*this, m.self()); }
+  template<typename M> Compact<Array, M> operator[](const Expr<M> &m) &&{ return Compact<Array, M>(*this, m.self()); }
+
+private:
+  template<typename Op, typename E> Array& update(const E &e);
+  template<typename S> Array& compact(const S &source);   //Selected elements of a masked source
+
+  std::unique_ptr<T[]> data;
+  size_t n = 0;
+};
+
+template<typename T>
+Array<T>::Array(size_t _n){
+  resize(_n);
+}
+
+template<typename T>
+Array<T>::Array(const T &v, size_t _n){
+  resize(_n, v);
+}
+
+template<typename T>
+Array<T>::Array(std::initializer_list<T> list){
+  resize(list.size());
+  std::copy(list.begin(), list.end(), data.get());
+}
+
+template<typename T>
+Array<T>::Array(const Array &other){
+  *this = other;
+}
+
+template<typename T>
+Array<T>::Array(Array &&other){
+  *this = std::move(other);
+}
+
+template<typename T>
+template<typename E>
+Array<T>::Array(const Expr<E> &e){
+  *this = e;
+}
+
+template<typename T>
+template<typename E, typename M>
+Array<T>::Array(const Compact<E, M> &c){
+  *this = c;
+}
+
+template<typename T>
+template<typename M>
+Array<T>::Array(const MaskRef<T, M> &r){
+  *this = r;
+}
+
+template<typename T>
+Array<T>& Array<T>::operator=(const Array &other){
+  if(this != &other){
+    if(n != other.n) resize(other.n);
+    std::copy(other.data.get(), other.data.get()+n, data.get());
+  }
+  return *this;
+}
+
+template<typename T>
+Array<T>& Array<T>::operator=(Array &&other){
+  data = std::move(other.data);
+  n = other.n;
+  other.n = 0;
+  return *this;
+}
+
+template<typename T>
+Array<T>& Array<T>::operator=(const T &v){
+  std::fill(data.get(), data.get()+n, v);
+  return *this;
+}
+
+template<typename T>
+template<typename E>
+Array<T>& Array<T>::operator=(const Expr<E> &e){
+  if(n != e.size()) resize(e.size());
+  return update<Assign>(e.self());
+}
+
+template<typename T>
+template<typename S>
+Array<T>& Array<T>::compact(const S &source){
+  //Count first, the values are then read in order. The source may read this
+  //array (a = a[mask]), so it is compacted into new storage before the swap
+  size_t count = 0;
+  for(size_t i = source.next(0); i < source.end(); i = source.next(i+1)) count++;
+  Array out(count);
+  size_t j = 0;
+  for(size_t i = source.next(0); i < source.end(); i = source.next(i+1)){
+    out.data[j++] = (T)source.value(i);
+  }
+  return *this = std::move(out);
+}
+
+template<typename T>
+void Array<T>::resize(size_t _n, T v){
+  if(_n != n){
+    data.reset((_n > 0)?new T[_n]:nullptr);
+    n = _n;
+  }
+  if(n > 0) std::fill(&data[0], &data[0]+n, v);
+}
+
+template<typename T>
+template<typename Op, typename E>
+Array<T>& Array<T>::update(const E &e){
+  //Every element only depends on its own index, so this can be split up
+  #pragma omp parallel for num_threads(solve::workers(n))
+  for(size_t i = 0; i < n; i++){
+    Op()(data[i], (T)e[i]);
+  }
+  return *this;
+}
+
+/*
+================================================================================
+                                  Reductions
+================================================================================
+*/
+
+template<typename D>
+auto Expr<D>::sum() const{
+  typename D::value_type s = typename D::value_type();
+  for(size_t i = 0; i < size(); i++) s += self()[i];
+  return s;
+}
+
+template<typename D>
+auto Expr<D>::max() const{
+  typename D::value_type s = self()[0];
+  for(size_t i = 1; i < size(); i++) if(s < self()[i]) s = self()[i];
+  return s;
+}
+
+template<typename D>
+auto Expr<D>::min() const{
+  typename D::value_type s = self()[0];
+  for(size_t i = 1; i < size(); i++) if(self()[i] < s) s = self()[i];
+  return s;
+}
+
+/*
+================================================================================
+                                  Operators
+================================================================================
+*/
+
+//Element Operations
+struct Plus{ template<typename A, typename B> auto operator()(const A &a, const B &b) const { return a + b; } };
+struct Minus{ template<typename A, typename B> auto operator()(const A &a, const B &b) const { return a - b; } };
+struct Times{ template<typename A, typename B> auto operator()(const A &a, const B &b) const { return a * b; } };
+struct Divide{ template<typename A, typename B> auto operator()(const A &a, const B &b) const { return a / b; } };
+struct Less{ template<typename A, typename B> bool operator()(const A &a, const B &b) const { return a < b; } };
+struct Greater{ template<typename A, typename B> bool operator()(const A &a, const B &b) const { return a > b; } };
+struct LessEqual{ template<typename A, typename B> bool operator()(const A &a, const B &b) const { return a <= b; } };
+struct GreaterEqual{ template<typename A, typename B> bool operator()(const A &a, const B &b) const { return a >= b; } };
+struct Equal{ template<typename A, typename B> bool operator()(const A &a, const B &b) const { return equal(a, b); } };
+struct NotEqual{ template<typename A, typename B> bool operator()(const A &a, const B &b) const { return !equal(a, b); } };
+struct And{ bool operator()(bool a, bool b) const { return a && b; } };
+struct Or{ bool operator()(bool a, bool b) const { return a || b; } };
+struct Negate{ template<typename A> A operator()(const A &a) const { return -a; } };
+struct Not{ bool operator()(bool a) const { return !a; } };
+struct Exp{ template<typename A> A operator()(const A &a) const { return std::exp(a); } };
+struct Sqrt{ template<typename A> A operator()(const A &a) const { return std::sqrt(a); } };
+struct Abs{ template<typename A> auto operator()(const A &a) const { return std::abs(a); } };
+
+//End of namespace
+}
+
+using lazy::Array;
+using lazy::Expr;
+using lazy::Binary;
+using lazy::Unary;
+using lazy::Constant;
+
+//Arithmetic between arrays / expressions, and with scalars of their type
+template<typename L, typename R> Binary<lazy::Plus, L, R> operator+(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Plus, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::Plus, L, Constant<typename L::value_type>> operator+(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::Plus, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+template<typename R> Binary<lazy::Plus, Constant<typename R::value_type>, R> operator+(const typename R::value_type &l, const Expr<R> &r){ return Binary<lazy::Plus, Constant<typename R::value_type>, R>(Constant<typename R::value_type>(l, r.size()), r.self()); }
+
+template<typename L, typename R> Binary<lazy::Minus, L, R> operator-(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Minus, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::Minus, L, Constant<typename L::value_type>> operator-(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::Minus, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+template<typename R> Binary<lazy::Minus, Constant<typename R::value_type>, R> operator-(const typename R::value_type &l, const Expr<R> &r){ return Binary<lazy::Minus, Constant<typename R::value_type>, R>(Constant<typename R::value_type>(l, r.size()), r.self()); }
+
+template<typename L, typename R> Binary<lazy::Times, L, R> operator*(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Times, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::Times, L, Constant<typename L::value_type>> operator*(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::Times, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+template<typename R> Binary<lazy::Times, Constant<typename R::value_type>, R> operator*(const typename R::value_type &l, const Expr<R> &r){ return Binary<lazy::Times, Constant<typename R::value_type>, R>(Constant<typename R::value_type>(l, r.size()), r.self()); }
+
+template<typename L, typename R> Binary<lazy::Divide, L, R> operator/(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Divide, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::Divide, L, Constant<typename L::value_type>> operator/(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::Divide, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+template<typename R> Binary<lazy::Divide, Constant<typename R::value_type>, R> operator/(const typename R::value_type &l, const Expr<R> &r){ return Binary<lazy::Divide, Constant<typename R::value_type>, R>(Constant<typename R::value_type>(l, r.size()), r.self()); }
+
+//Comparisons give boolean expressions, which can be used as masks
+template<typename L, typename R> Binary<lazy::Less, L, R> operator<(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Less, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::Less, L, Constant<typename L::value_type>> operator<(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::Less, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+
+template<typename L, typename R> Binary<lazy::Greater, L, R> operator>(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Greater, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::Greater, L, Constant<typename L::value_type>> operator>(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::Greater, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+
+template<typename L, typename R> Binary<lazy::LessEqual, L, R> operator<=(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::LessEqual, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::LessEqual, L, Constant<typename L::value_type>> operator<=(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::LessEqual, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+
+template<typename L, typename R> Binary<lazy::GreaterEqual, L, R> operator>=(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::GreaterEqual, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::GreaterEqual, L, Constant<typename L::value_type>> operator>=(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::GreaterEqual, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+
+template<typename L, typename R> Binary<lazy::Equal, L, R> operator==(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Equal, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::Equal, L, Constant<typename L::value_type>> operator==(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::Equal, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+
+template<typename L, typename R> Binary<lazy::NotEqual, L, R> operator!=(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::NotEqual, L, R>(l.self(), r.self()); }
+template<typename L> Binary<lazy::NotEqual, L, Constant<typename L::value_type>> operator!=(const Expr<L> &l, const typename L::value_type &r){ return Binary<lazy::NotEqual, L, Constant<typename L::value_type>>(l.self(), Constant<typename L::value_type>(r, l.size())); }
+
+//Combining Masks
+template<typename L, typename R> Binary<lazy::And, L, R> operator&&(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::And, L, R>(l.self(), r.self()); }
+template<typename L, typename R> Binary<lazy::Or, L, R> operator||(const Expr<L> &l, const Expr<R> &r){ return Binary<lazy::Or, L, R>(l.self(), r.self()); }
+template<typename A> Unary<lazy::Not, A> operator!(const Expr<A> &a){ return Unary<lazy::Not, A>(a.self()); }
+
+//Element Functions
+template<typename A> Unary<lazy::Negate, A> operator-(const Expr<A> &a){ return Unary<lazy::Negate, A>(a.self()); }
+template<typename A> Unary<lazy::Exp, A> exp(const Expr<A> &a){ return Unary<lazy::Exp, A>(a.self()); }
+template<typename A> Unary<lazy::Sqrt, A> sqrt(const Expr<A> &a){ return Unary<lazy::Sqrt, A>(a.self()); }
+template<typename A> Unary<lazy::Abs, A> abs(const Expr<A> &a){ return Unary<lazy::Abs, A>(a.self()); }
@@ -0,0 +1,172 @@
+/*
+================================================================================
+                      Dual-Representation Spectral Field
+================================================================================
+*/
+
+/*
+A field that holds both its physical (grid) and spectral (fourier) values.
+Only one of them has to be current, the other one is converted lazily when
+it is asked for. Spectral operators work on the spectrum directly, so they
+can be chained without transforming back and forth.
+*/
+
+namespace solve{
+
+template<typename T>
+class Field{
+public:
+  //Construction (starts in physical or spectral space)
+  Field(){}
+  Field(const Array<T> &field);
+  static Field fromSpectrum(const CArray &coef);
+
+  //Read Access (converts if stale, both stay valid)
+  const Array<T>& physical();
+  const CArray& spectral();
+
+  //Write Access (invalidates the other representation)
+  Array<T>& editPhysical();
+  CArray& editSpectral();
+
+  //Current Representations
+  bool isPhysical(){ return physValid; }
+  bool isSpectral(){ return specValid; }
+
+  //Batched Conversion
+  template<typename S> friend void spectral(const std::vector<Field<S>*> &fields);
+  template<typename S> friend void physical(const std::vector<Field<S>*> &fields);
+
+private:
+  Array<T> phys;
+  CArray spec;
+  bool physValid = false;
+  bool specValid = false;
+};
+
+//Spectral Operators on Fields (no round-trips)
+template<typename T> Field<T> diff(Field<T> &field, int x, int y);              //Differential, stays spectral
+template<typename T> Field<T>& diffuse(Field<T> &field, double mu, int cycles);  //Diffuses in place, stays spectral
+
+//Batched Conversion (one transform for all stale fields)
+template<typename T> void spectral(const std::vector<Field<T>*> &fields);        //Makes every spectrum current
+template<typename T> void physical(const std::vector<Field<T>*> &fields);        //Makes every grid current
+
+/*
+================================================================================
+                              Field Members
+================================================================================
+*/
+
+template<typename T>
+Field<T>::Field(const Array<T> &field){
+  phys = field;
+  physValid = true;
+}
+
+template<typename T>
+Field<T> Field<T>::fromSpectrum(const CArray &coef){
+  Field<T> field;
+  field.spec = coef;
+  field.specValid = true;
+  return field;
+}
+
+template<typename T>
+const Array<T>& Field<T>::physical(){
+  if(!physValid){
+    phys = backward<T>(spec);
+    physValid = true;
+  }
+  return phys;
+}
+
+template<typename T>
+const CArray& Field<T>::spectral(){
+  if(!specValid){
+    spec = forward<T>(phys);
+    specValid = true;
+  }
+  return spec;
+}
+
+template<typename T>
+Array<T>& Field<T>::editPhysical(){
+  physical();
+  specValid = false;
+  return phys;
+}
+
+template<typename T>
+CArray& Field<T>::editSpectral(){
+  spectral();
+  physValid = false;
+  return spec;
+}
+
+/*
+================================================================================
+                            Spectral Operators
+================================================================================
+*/
+
+template<typename T>
+Field<T> diff(Field<T> &field, int x, int y){
+  return Field<T>::fromSpectrum(fdiff(field.spectral(), x, y, half<T>()));
+}
+
+template<typename T>
+Field<T>& diffuse(Field<T> &field, double mu, int cycles){
+  CArray &coef = field.editSpectral();
+  coef = fdiffuse(coef, mu, cycles, half<T>());
+  return field;
+}
+
+/*
+================================================================================
+                            Batched Conversion
+================================================================================
+*/
+
+template<typename T>
+void spectral(const std::vector<Field<T>*> &fields){
+  //Collect the stale spectra
+  std::vector<Field<T>*> stale;
+  Span<T> grids;
+  for(Field<T>* field: fields){
+    if(field->specValid) continue;
+    stale.push_back(field);
+    grids.push_back(&field->phys);
+  }
+  if(stale.empty()) return;
+
+  //Transform them together
+  std::vector<CArray> coefs = forward<T>(grids);
+  for(unsigned int i = 0; i < stale.size(); i++){
+    stale[i]->spec = coefs[i];
+    stale[i]->specValid = true;
+  }
+}
+
+template<typename T>
+void physical(const std::vector<Field<T>*> &fields){
+  //Collect the stale grids
+  std::vector<Field<T>*> stale;
+  std::vector<CArray> coefs;
+  for(Field<T>* field: fields){
+    if(field->physValid) continue;
+    stale.push_back(field);
+    coefs.push_back(field->spec);
+  }
+  if(stale.empty()) return;
+
+  //Transform them together
+  std::vector<Array<T>> grids = backward<T>(coefs);
+  for(unsigned int i = 0; i < stale.size(); i++){
+    stale[i]->phys = grids[i];
+    stale[i]->physValid = true;
+  }
+}
+
+//End of namespace
+}
@@ -0,0 +1,261 @@
+#include <memory>
+#include <mutex>
+
+/*
+================================================================================
+                            Convolution Kernels
+================================================================================
+*/
+
+/*
+A kernel that is used more than once should be kept as a Kernel object. It
+keeps the padded spectrum of every grid it is applied on, so the kernel is only
+transformed once per grid. The spectra belong to the kernel (and its copies)
+and go away with it, those of grids that were resized or destroyed are dropped
+on the next lookup. Small kernels skip the transforms altogether and are
+applied as a direct stencil, which is much cheaper than two full FFTs.
+
+Most kernels are separable or a sum of a few separable terms (the binomial
+kernel is u*v with u = v = (1, 2, 1)/4). The constructor factors the weights
+into such terms, and if they have fewer taps than the dense kernel, the
+stencil runs as 1D passes along y and then along x instead, O(k) instead of
+O(k²) per cell.
+
+Both paths compute the same periodic convolution:
+  out(p) = sum over (k, l) of kernel(k, l) * field(p + center - (k, l))
+*/
+
+namespace solve{
+
+template<typename T>
+class Kernel{
+public:
+  Kernel(const Array<T> &_weights, glm::vec2 _size);
+
+  const Array<T>& weights() const { return w; }
+  glm::vec2 size() const { return s; }
+
+  bool direct() const;                        //Stencil instead of FFT on the bound grid
+  Array<T> apply(const Array<T> &field) const;
+
+private:
+  struct Tap{
+    int k, l;     //Position in the kernel
+    T w;
+  };
+
+  struct Term{
+    std::vector<Tap> u;       //Weights along x (l = 0)
+    std::vector<Tap> v;       //Weights along y (k = 0)
+  };
+
+  struct Spectrum{
+    std::weak_ptr<char> grid;                 //Token of the grid (expires when it's resized or destroyed)
+    bool half;
+    std::shared_ptr<CArray> coef;
+  };
+
+  //Shared by the copies of a kernel, they have the same weights
+  struct Cache{
+    std::mutex lock;
+    std::vector<Spectrum> spectra;
+  };
+
+  void factorize();                           //Separable terms, if they are cheaper
+  int cost() const;                           //Multiply-adds per cell of the stencil
+  CArray transform() const;                   //Padded spectrum on the bound grid
+  std::shared_ptr<CArray> spectrum() const;   //Padded spectrum, kept for the bound grid
+  Array<T> stencil(const Array<T> &field) const;
+  Array<T> separable(const Array<T> &field) const;
+
+  Array<T> w;
+  glm::vec2 s;
+  std::vector<Tap> taps;                      //Nonzero weights
+  std::vector<Term> terms;                    //Separable terms (empty for dense kernels)
+  std::shared_ptr<Cache> cache = std::make_shared<Cache>();
+};
+
+template<typename T>
+Kernel<T>::Kernel(const Array<T> &_weights, glm::vec2 _size){
+  w = _weights;
+  s = _size;
+  for(int k = 0; k < s.x; k++){
+    for(int l = 0; l < s.y; l++){
+      T _w = w[k*(int)s.y+l];
+      if(_w != (T)0.0) taps.push_back({k, l, _w});
+    }
+  }
+  factorize();
+}
+
+template<typename T>
+void Kernel<T>::factorize(){
+  //Cross approximation with full pivoting: every step removes the rank one
+  //term through the largest remaining weight, until nothing is left
+  const int nk = s.x, nl = s.y;
+  std::vector<T> r(&w[0], &w[0]+nk*nl);
+  double scale = 0.0;
+  for(const T &_w: r) scale = std::max(scale, (double)std::abs(_w));
+
+  std::vector<Term> _terms;
+  int _cost = 0;
+  while(true){
+    int p = 0;
+    for(int i = 1; i < nk*nl; i++){
+      if(std::abs(r[i]) > std::abs(r[p])) p = i;
+    }
+    if(std::abs(r[p]) <= 1E-12*scale) break;
+
+    //u = column through the pivot, v = row through the pivot / pivot
+    const int pk = p/nl, pl = p%nl;
+    Term t;
+    for(int k = 0; k < nk; k++){
+      if(r[k*nl+pl] != (T)0.0) t.u.push_back({k, 0, r[k*nl+pl]});
+    }
+    for(int l = 0; l < nl; l++){
+      if(r[pk*nl+l] != (T)0.0) t.v.push_back({0, l, r[pk*nl+l]/r[p]});
+    }
+    for(const Tap &a: t.u){
+      for(const Tap &b: t.v){
+        r[a.k*nl+b.l] -= a.w*b.w;
+      }
+    }
+    r[p] = (T)0.0;    //Exactly removed
+
+    _cost += t.u.size()+t.v.size();
+    _terms.push_back(std::move(t));
+    if(_cost >= (int)taps.size()) return;   //Dense is cheaper
+  }
+  terms = std::move(_terms);
+}
+
+template<typename T>
+int Kernel<T>::cost() const{
+  if(terms.empty()) return taps.size();
+  int c = 0;
+  for(const Term &t: terms) c += t.u.size()+t.v.size();
+  return c;
+}
+
+template<typename T>
+bool Kernel<T>::direct() const{
+  //A stencil costs a multiply-add per tap and cell, an FFT pair a few per log2(N)
+  return cost() <= 3*std::log2(std::max(grid().N, 2));
+}
+
+template<typename T>
+Array<T> Kernel<T>::apply(const Array<T> &field) const{
+  if(direct()){
+    return (terms.empty())?stencil(field):separable(field);
+  }
+  CArray coef = forward<T>(field);
+  std::shared_ptr<CArray> spec = spectrum();
+  const CArray &_k = *spec;
+  #pragma omp parallel for num_threads(workers(coef.size()))
+  for(unsigned int i = 0; i < coef.size(); i++){
+    coef[i] *= _k[i];
+  }
+  return backward<T>(coef);
+}
+
+template<typename T>
+CArray Kernel<T>::transform() const{
+  //Center the kernel on the origin of a padded grid (weights beyond the grid wrap and add up)
+  Array<T> padded((T)0.0, grid().N);
+  for(int k = 0; k < s.x; k++){
+    for(int l = 0; l < s.y; l++){
+      padded[ind(glm::vec2(k, l)-glm::floor(s/glm::vec2(2)))] += w[ind(glm::vec2(k, l), s)];
+    }
+  }
+  return forward<T>(padded);
+}
+
+template<typename T>
+std::shared_ptr<CArray> Kernel<T>::spectrum() const{
+  Grid &_g = grid();
+  std::lock_guard<std::mutex> lock(cache->lock);
+  std::vector<Spectrum> &_s = cache->spectra;
+  _s.erase(std::remove_if(_s.begin(), _s.end(), [](const Spectrum &a){ return a.grid.expired(); }), _s.end());
+  for(const Spectrum &a: _s){
+    if(a.half == half<T>() && a.grid.lock() == _g.token) return a.coef;
+  }
+  _s.push_back({_g.token, half<T>(), std::make_shared<CArray>(transform())});
+  return _s.back().coef;
+}
+
+template<typename T>
+Array<T> Kernel<T>::stencil(const Array<T> &field) const{
+  glm::vec2 modes = grid().modes;
+  const int nx = modes.x, ny = modes.y;
+  const int cx = s.x/2, cy = s.y/2;
+  Array<T> out((T)0.0, nx*ny);
+
+  //Every row adds shifted source rows, the wrap in y splits them in two runs
+  #pragma omp parallel for num_threads(workers(nx*ny))
+  for(int x = 0; x < nx; x++){
+    T* o = &out[x*ny];
+    for(const Tap &t: taps){
+      int sx = ((x+cx-t.k)%nx+nx)%nx;
+      int oy = ((cy-t.l)%ny+ny)%ny;
+      const T* f = &field[sx*ny];
+      for(int y = 0; y < ny-oy; y++) o[y] += t.w*f[y+oy];
+      for(int y = ny-oy; y < ny; y++) o[y] += t.w*f[y+oy-ny];
+    }
+  }
+  return out;
+}
+
+template<typename T>
+Array<T> Kernel<T>::separable(const Array<T> &field) const{
+  glm::vec2 modes = grid().modes;
+  const int nx = modes.x, ny = modes.y;
+  const int cx = s.x/2, cy = s.y/2;
+  Array<T> out((T)0.0, nx*ny);
+  Array<T> pass(nx*ny);
+
+  for(const Term &t: terms){
+    //Along y: every row is convolved with v on its own
+    #pragma omp parallel for num_threads(workers(nx*ny))
+    for(int x = 0; x < nx; x++){
+      T* o = &pass[x*ny];
+      const T* f = &field[x*ny];
+      for(int y = 0; y < ny; y++) o[y] = (T)0.0;
+      for(const Tap &b: t.v){
+        int oy = ((cy-b.l)%ny+ny)%ny;
+        for(int y = 0; y < ny-oy; y++) o[y] += b.w*f[y+oy];
+        for(int y = ny-oy; y < ny; y++) o[y] += b.w*f[y+oy-ny];
+      }
+    }
+
+    //Along x: shifts in x move whole rows, so this also runs over contiguous rows
+    #pragma omp parallel for num_threads(workers(nx*ny))
+    for(int x = 0; x < nx; x++){
+      T* o = &out[x*ny];
+      for(const Tap &a: t.u){
+        const T* f = &pass[((x+cx-a.k)%nx+nx)%nx*ny];
+        for(int y = 0; y < ny; y++) o[y] += a.w*f[y];
+      }
+    }
+  }
+  return out;
+}
+
+/*
+================================================================================
+                                Convolution
+================================================================================
+*/
+
+template<typename E>
+ArrayOf<E> convolve(const E &field, const Kernel<typename E::value_type> &kernel){
+  return kernel.apply(field);
+}
+
+template<typename E>
+ArrayOf<E> convolve(const E &field, const ArrayOf<E> &kernel, glm::vec2 ksize){
+  //One-off kernel, keep a Kernel to reuse its spectrum
+  return Kernel<typename E::value_type>(kernel, ksize).apply(field);
+}
+
+//End of namespace
+}
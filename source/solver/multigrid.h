@@ -0,0 +1,451 @@
+/*
+================================================================================
+                          Geometric Multigrid Solver
+================================================================================
+*/
+
+/*
+Solves (alpha - beta*laplace) u = f on the grid, with Poisson (alpha = 0) and
+Helmholtz problems as the usual cases. The grid spans the unit square like the
+spectral helpers (spacing 1/modes), values sit at the cell centers and the
+boundary is periodic, or homogeneous Dirichlet (u = 0) / Neumann (du/dn = 0) on
+the cell faces around the grid.
+
+The grid is coarsened by 2 (odd sizes round up, the cells of the two levels
+then don't nest) until at most 64 cells are left, which are solved directly.
+On elongated grids, only the finer axis is coarsened until both are alike.
+A full multigrid pass gives the first guess, then V-cycles with red-black
+Gauss-Seidel smoothing run until the residual is small enough. Every sweep is
+O(N) and the direct solve has a fixed size, so the whole solve is O(N) for any
+grid size.
+*/
+
+namespace solve{
+
+enum Boundary{ PERIODIC, DIRICHLET, NEUMANN };
+
+template<typename T>
+class Multigrid{
+public:
+  Multigrid(Boundary _boundary = PERIODIC, double _alpha = 0.0, double _beta = 1.0);
+
+  //Problem
+  Boundary boundary;
+  double alpha;                 //(alpha - beta*laplace) u = f
+  double beta;
+
+  //Settings
+  int cycles = 20;              //Maximum number of V-cycles
+  double tolerance = 1E-8;      //Residual relative to the right-hand side
+  int smoothing = 2;            //Sweeps before and after the coarse correction
+
+  //Results of the last solve
+  int iterations = 0;           //V-cycles
+  double residual = 0.0;        //Relative residual
+
+  //Solve on the bound grid
+  Array<T> solve(const Array<T> &f);          //Full multigrid, then V-cycles
+  void solve(Array<T> &u, const Array<T> &f); //V-cycles from an initial guess
+
+private:
+  //Transfer along one axis between a level and the next finer one
+  struct Transfer{
+    std::vector<int> lower;       //Prolongation: coarse cell below every fine center (-1 at the boundary)
+    std::vector<double> t;        //Weight of the coarse cell above
+    std::vector<int> first;       //Restriction: fine cells first[I] .. first[I+1] overlap coarse cell I
+    std::vector<int> cell;
+    std::vector<double> weight;   //Overlapping fraction of the coarse cell
+  };
+
+  struct Level{
+    int nx, ny;
+    double ax, ay;              //beta/h² in x and y
+    Array<T> u, f, r;
+    Transfer tx, ty;            //From the next finer level
+  };
+
+  void build(glm::vec2 modes);                  //Level hierarchy (only when the size changes)
+  void scale();                                 //Operator coefficients of every level, factors the coarsest
+  Transfer transfer(int fine, int coarse);
+  bool singular();                              //Solution only defined up to a constant
+  T at(const Level &l, const Array<T> &a, int i, int j);  //Value with the boundary condition applied
+  T apply(const Level &l, const Array<T> &a, int i, int j);  //(alpha - beta*laplace) a at a cell
+  void smooth(Level &l, int sweeps);
+  double residuals(Level &l);                   //Residual into r, returns its rms
+  void restrict(Level &fine, Level &coarse);    //Area weighted residual into f
+  void prolong(Level &coarse, Level &fine);     //Bilinear correction
+  void vcycle(int k);
+  void coarsest();                              //Direct solve with the factored operator
+  double norm(const Array<T> &a);
+
+  std::vector<Level> levels;
+  glm::vec2 size = glm::vec2(0);
+  std::vector<double> lu;                       //LU factors of the coarsest operator (row pivoting)
+  std::vector<int> pivots;
+};
+
+/*
+================================================================================
+                            Convenience Functions
+================================================================================
+*/
+
+template<typename T> Array<T> poisson(const Array<T> &f, Boundary boundary = PERIODIC);                         //Solves laplace(u) = f
+template<typename T> Array<T> helmholtz(const Array<T> &f, double alpha, double beta, Boundary boundary = PERIODIC);  //Solves (alpha - beta*laplace) u = f
+template<typename T> Array<T> implicitDiffuse(const Array<T> &field, double mu, double dt, Boundary boundary);  //One implicit euler diffusion step
+
+template<typename T>
+Array<T> poisson(const Array<T> &f, Boundary boundary){
+  Multigrid<T> mg(boundary, 0.0, -1.0);
+  return mg.solve(f);
+}
+
+template<typename T>
+Array<T> helmholtz(const Array<T> &f, double alpha, double beta, Boundary boundary){
+  Multigrid<T> mg(boundary, alpha, beta);
+  return mg.solve(f);
+}
+
+template<typename T>
+Array<T> implicitDiffuse(const Array<T> &field, double mu, double dt, Boundary boundary){
+  //(1 - dt*mu*laplace) u' = u, the field is a good first guess
+  Multigrid<T> mg(boundary, 1.0, mu*dt);
+  Array<T> u = field;
+  mg.solve(u, field);
+  return u;
+}
+
+/*
+================================================================================
+                              Multigrid Members
+================================================================================
+*/
+
+template<typename T>
+Multigrid<T>::Multigrid(Boundary _boundary, double _alpha, double _beta){
+  boundary = _boundary;
+  alpha = _alpha;
+  beta = _beta;
+}
+
+template<typename T>
+void Multigrid<T>::build(glm::vec2 modes){
+  if(modes == size){
+    return;
+  }
+  size = modes;
+  levels.clear();
+
+  int nx = modes.x, ny = modes.y;
+  while(true){
+    Level l;
+    l.nx = nx;
+    l.ny = ny;
+    l.u.resize(nx*ny);
+    l.f.resize(nx*ny);
+    l.r.resize(nx*ny);
+    if(!levels.empty()){
+      l.tx = transfer(levels.back().nx, nx);
+      l.ty = transfer(levels.back().ny, ny);
+    }
+    levels.push_back(std::move(l));
+    if(nx*ny <= 64) break;
+
+    //The grid spans the unit square, so different sizes couple the axes
+    //differently (beta*n²). Only the strongly coupled axes are coarsened,
+    //until both couple alike, point smoothing can't handle the other ones.
+    bool cx = nx > 2 && 2*nx*nx >= ny*ny;
+    bool cy = ny > 2 && 2*ny*ny >= nx*nx;
+    if(cx) nx = (nx+1)/2;
+    if(cy) ny = (ny+1)/2;
+  }
+}
+
+template<typename T>
+typename Multigrid<T>::Transfer Multigrid<T>::transfer(int fine, int coarse){
+  Transfer tr;
+  for(int i = 0; i < fine; i++){
+    //Fine cell center in coarse cell coordinates (centers at integers)
+    double x = (i+0.5)*coarse/fine-0.5;
+    int lower = std::floor(x);
+    tr.lower.push_back(lower);
+    tr.t.push_back(x-lower);
+  }
+  for(int I = 0; I < coarse; I++){
+    tr.first.push_back(tr.cell.size());
+    for(int i = I*fine/coarse; i < fine && i*coarse < (I+1)*fine; i++){
+      //Overlap of [i, i+1)/fine and [I, I+1)/coarse, relative to the coarse cell
+      double lo = std::max((double)i*coarse, (double)I*fine);
+      double hi = std::min((double)(i+1)*coarse, (double)(I+1)*fine);
+      if(hi <= lo) continue;
+      tr.cell.push_back(i);
+      tr.weight.push_back((hi-lo)/fine);
+    }
+  }
+  tr.first.push_back(tr.cell.size());
+  return tr;
+}
+
+template<typename T>
+void Multigrid<T>::scale(){
+  for(unsigned int k = 0; k < levels.size(); k++){
+    Level &l = levels[k];
+    l.ax = beta*l.nx*l.nx;
+    l.ay = beta*l.ny*l.ny;
+  }
+
+  //Dense operator of the coarsest level, one column per unit vector
+  Level &l = levels.back();
+  const int n = l.nx*l.ny;
+  lu.assign(n*n, 0.0);
+  pivots.resize(n);
+  Array<T> e((T)0.0, n);
+  for(int c = 0; c < n; c++){
+    e[c] = (T)1.0;
+    for(int i = 0; i < l.nx; i++){
+      for(int j = 0; j < l.ny; j++){
+        lu[(i*l.ny+j)*n+c] = std::real(apply(l, e, i, j));
+      }
+    }
+    e[c] = (T)0.0;
+  }
+
+  //Constants solve the singular problems, a rank one term pins their mean to zero
+  if(singular()){
+    double d = 2*l.ax+2*l.ay;
+    for(int i = 0; i < n*n; i++) lu[i] += d/n;
+  }
+
+  //LU with row pivoting
+  for(int k = 0; k < n; k++){
+    int p = k;
+    for(int i = k+1; i < n; i++){
+      if(std::abs(lu[i*n+k]) > std::abs(lu[p*n+k])) p = i;
+    }
+    pivots[k] = p;
+    if(p != k){
+      for(int j = 0; j < n; j++) std::swap(lu[k*n+j], lu[p*n+j]);
+    }
+    if(lu[k*n+k] == 0.0) continue;
+    for(int i = k+1; i < n; i++){
+      double m = (lu[i*n+k] /= lu[k*n+k]);
+      for(int j = k+1; j < n; j++) lu[i*n+j] -= m*lu[k*n+j];
+    }
+  }
+}
+
+template<typename T>
+bool Multigrid<T>::singular(){
+  return alpha == 0.0 && boundary != DIRICHLET;
+}
+
+template<typename T>
+T Multigrid<T>::at(const Level &l, const Array<T> &a, int i, int j){
+  T sign = (T)1.0;
+  if(i < 0 || i >= l.nx){
+    if(boundary == PERIODIC) i = (i+l.nx)%l.nx;
+    else{
+      i = (i < 0)?0:l.nx-1;   //Mirror at the face
+      if(boundary == DIRICHLET) sign = -sign;
+    }
+  }
+  if(j < 0 || j >= l.ny){
+    if(boundary == PERIODIC) j = (j+l.ny)%l.ny;
+    else{
+      j = (j < 0)?0:l.ny-1;
+      if(boundary == DIRICHLET) sign = -sign;
+    }
+  }
+  return sign*a[i*l.ny+j];
+}
+
+template<typename T>
+T Multigrid<T>::apply(const Level &l, const Array<T> &a, int i, int j){
+  const T c = a[i*l.ny+j];
+  T lap = (T)l.ax*(at(l, a, i-1, j)+at(l, a, i+1, j)-(T)2.0*c)
+        + (T)l.ay*(at(l, a, i, j-1)+at(l, a, i, j+1)-(T)2.0*c);
+  return (T)alpha*c-lap;
+}
+
+template<typename T>
+void Multigrid<T>::smooth(Level &l, int sweeps){
+  for(int s = 0; s < sweeps; s++){
+    //Red-black: points of one color only depend on the other color
+    //(odd periodic sizes wrap onto the same color, those rows stay in order)
+    int threads = (boundary == PERIODIC && l.nx%2 == 1)?1:workers(l.nx*l.ny);
+    for(int color = 0; color < 2; color++){
+      #pragma omp parallel for num_threads(threads)
+      for(int i = 0; i < l.nx; i++){
+        for(int j = (i+color)%2; j < l.ny; j += 2){
+          //Mirrored neighbors fold into the diagonal (+u for Dirichlet, -u for Neumann)
+          double diag = alpha;
+          T off = (T)0.0;
+          if(i > 0 || boundary == PERIODIC) off += (T)l.ax*at(l, l.u, i-1, j); else diag += (boundary == DIRICHLET)?l.ax:-l.ax;
+          if(i < l.nx-1 || boundary == PERIODIC) off += (T)l.ax*at(l, l.u, i+1, j); else diag += (boundary == DIRICHLET)?l.ax:-l.ax;
+          if(j > 0 || boundary == PERIODIC) off += (T)l.ay*at(l, l.u, i, j-1); else diag += (boundary == DIRICHLET)?l.ay:-l.ay;
+          if(j < l.ny-1 || boundary == PERIODIC) off += (T)l.ay*at(l, l.u, i, j+1); else diag += (boundary == DIRICHLET)?l.ay:-l.ay;
+          diag += 2*l.ax+2*l.ay;
+          int n = i*l.ny+j;
+          //Neumann corners of a single cell have no equation left
+          if(diag != 0.0) l.u[n] = (l.f[n]+off)/(T)diag;
+        }
+      }
+    }
+  }
+}
+
+template<typename T>
+double Multigrid<T>::residuals(Level &l){
+  #pragma omp parallel for num_threads(workers(l.nx*l.ny))
+  for(int i = 0; i < l.nx; i++){
+    for(int j = 0; j < l.ny; j++){
+      int n = i*l.ny+j;
+      l.r[n] = l.f[n]-apply(l, l.u, i, j);
+    }
+  }
+  return norm(l.r);
+}
+
+template<typename T>
+void Multigrid<T>::restrict(Level &fine, Level &coarse){
+  //Every coarse cell averages the fine cells it overlaps (four when the sizes are even)
+  const Transfer &tx = coarse.tx, &ty = coarse.ty;
+  #pragma omp parallel for num_threads(workers(coarse.nx*coarse.ny))
+  for(int I = 0; I < coarse.nx; I++){
+    for(int J = 0; J < coarse.ny; J++){
+      T v = (T)0.0;
+      for(int a = tx.first[I]; a < tx.first[I+1]; a++){
+        for(int b = ty.first[J]; b < ty.first[J+1]; b++){
+          v += (T)(tx.weight[a]*ty.weight[b])*fine.r[tx.cell[a]*fine.ny+ty.cell[b]];
+        }
+      }
+      coarse.f[I*coarse.ny+J] = v;
+    }
+  }
+  coarse.u = (T)0.0;
+}
+
+template<typename T>
+void Multigrid<T>::prolong(Level &coarse, Level &fine){
+  //Bilinear between the coarse centers around every fine center
+  //(a quarter coarse cell away from the nearest one when the sizes are even)
+  const Transfer &tx = coarse.tx, &ty = coarse.ty;
+  #pragma omp parallel for num_threads(workers(fine.nx*fine.ny))
+  for(int i = 0; i < fine.nx; i++){
+    for(int j = 0; j < fine.ny; j++){
+      int I = tx.lower[i], J = ty.lower[j];
+      double s = tx.t[i], t = ty.t[j];
+      T c = (T)((1-s)*(1-t))*at(coarse, coarse.u, I, J)
+          + (T)(s*(1-t))*at(coarse, coarse.u, I+1, J)
+          + (T)((1-s)*t)*at(coarse, coarse.u, I, J+1)
+          + (T)(s*t)*at(coarse, coarse.u, I+1, J+1);
+      fine.u[i*fine.ny+j] += c;
+    }
+  }
+}
+
+template<typename T>
+void Multigrid<T>::coarsest(){
+  //At most 64 cells, forward and back substitution with the factors
+  Level &l = levels.back();
+  const int n = l.nx*l.ny;
+  Array<T> &x = l.u;
+  x = l.f;
+  for(int k = 0; k < n; k++){
+    if(pivots[k] != k) std::swap(x[k], x[pivots[k]]);
+  }
+  for(int k = 0; k < n; k++){
+    for(int i = k+1; i < n; i++) x[i] -= (T)lu[i*n+k]*x[k];
+  }
+  for(int k = n-1; k >= 0; k--){
+    for(int j = k+1; j < n; j++) x[k] -= (T)lu[k*n+j]*x[j];
+    x[k] = (lu[k*n+k] != 0.0)?x[k]/(T)lu[k*n+k]:(T)0.0;
+  }
+}
+
+template<typename T>
+void Multigrid<T>::vcycle(int k){
+  if(k == (int)levels.size()-1){
+    coarsest();
+    return;
+  }
+  Level &l = levels[k];
+  smooth(l, smoothing);
+  residuals(l);
+  restrict(l, levels[k+1]);
+  vcycle(k+1);
+  prolong(levels[k+1], l);
+  smooth(l, smoothing);
+}
+
+template<typename T>
+double Multigrid<T>::norm(const Array<T> &a){
+  double s = 0.0;
+  #pragma omp parallel for reduction(+:s) num_threads(workers(a.size()))
+  for(unsigned int i = 0; i < a.size(); i++){
+    s += std::norm(a[i]);
+  }
+  return std::sqrt(s/a.size());
+}
+
+template<typename T>
+Array<T> Multigrid<T>::solve(const Array<T> &f){
+  build(grid().modes);
+  scale();
+
+  //Right-hand side on every level
+  levels[0].f = f;
+  if(singular()){
+    levels[0].f -= levels[0].f.sum()/(T)f.size();   //Only the compatible part has a solution
+  }
+  for(unsigned int k = 1; k < levels.size(); k++){
+    levels[k-1].r = levels[k-1].f;
+    restrict(levels[k-1], levels[k]);
+  }
+
+  //Full multigrid: each level starts from the interpolated coarser solution
+  coarsest();
+  for(int k = levels.size()-2; k >= 0; k--){
+    levels[k].u = (T)0.0;
+    prolong(levels[k+1], levels[k]);
+    vcycle(k);
+  }
+
+  Array<T> u = levels[0].u;
+  solve(u, f);
+  iterations++;   //Count the full multigrid pass
+  return u;
+}
+
+template<typename T>
+void Multigrid<T>::solve(Array<T> &u, const Array<T> &f){
+  build(grid().modes);
+  scale();
+
+  Level &top = levels[0];
+  top.f = f;
+  if(singular()){
+    top.f -= top.f.sum()/(T)f.size();
+  }
+  top.u = u;
+  double scale = norm(top.f);
+  if(scale == 0.0) scale = 1.0;
+
+  //Finest level keeps the solution, coarser ones solve for the correction
+  iterations = 0;
+  residual = residuals(top)/scale;
+  while(residual > tolerance && iterations < cycles){
+    vcycle(0);
+    residual = residuals(top)/scale;
+    iterations++;
+  }
+
+  //Pin the free constant
+  if(singular()){
+    top.u -= top.u.sum()/(T)u.size();
+  }
+  u = top.u;
+}
+
+//End of namespace
+}
@@ -0,0 +1,85 @@
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+/*
+================================================================================
+                        Counter-Based Random Numbers
+================================================================================
+*/
+
+//Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+//The numbers of a counter are a fixed function of the seed and the counter, so
+//every cell draws from its own index and a field comes out the same on any
+//number of threads, in any order. There is no state to share or advance.
+
+namespace solve{
+
+class Philox{
+public:
+  Philox(uint64_t _seed = 0, uint64_t _stream = 0):seed(_seed),stream(_stream){}
+
+  std::array<uint32_t, 4> operator()(uint64_t counter) const;   //Four random words of a counter
+
+  double uniform(uint64_t counter) const;                 //[0, 1), 53 bits
+  double normal(uint64_t counter) const;                  //Standard normal (Box-Muller)
+  uint32_t integer(uint64_t counter, uint32_t n) const;   //[0, n)
+
+  uint64_t seed;      //Key
+  uint64_t stream;    //Independent sequences of the same seed
+};
+
+inline std::array<uint32_t, 4> Philox::operator()(uint64_t counter) const{
+  uint32_t c0 = counter, c1 = counter >> 32;
+  uint32_t c2 = stream, c3 = stream >> 32;
+  uint32_t k0 = seed, k1 = seed >> 32;
+  for(int r = 0; r < 10; r++){
+    uint64_t p0 = (uint64_t)0xD2511F53*c0;
+    uint64_t p1 = (uint64_t)0xCD9E8D57*c2;
+    uint32_t n0 = (uint32_t)(p1 >> 32)^c1^k0;
+    uint32_t n2 = (uint32_t)(p0 >> 32)^c3^k1;
+    c1 = p1;
+    c3 = p0;
+    c0 = n0;
+    c2 = n2;
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  return {c0, c1, c2, c3};
+}
+
+inline double Philox::uniform(uint64_t counter) const{
+  std::array<uint32_t, 4> w = (*this)(counter);
+  return (((uint64_t)w[0] << 21)^(w[1] >> 11))*0x1.0p-53;
+}
+
+inline double Philox::normal(uint64_t counter) const{
+  std::array<uint32_t, 4> w = (*this)(counter);
+  double u1 = ((((uint64_t)w[0] << 21)^(w[1] >> 11))+1)*0x1.0p-53;   //(0, 1], log stays finite
+  double u2 = (((uint64_t)w[2] << 21)^(w[3] >> 11))*0x1.0p-53;
+  return std::sqrt(-2.0*std::log(u1))*std::cos(2.0*PI*u2);
+}
+
+inline uint32_t Philox::integer(uint64_t counter, uint32_t n) const{
+  //Multiply-shift, the bias is below n/2^32
+  return ((uint64_t)(*this)(counter)[0]*n) >> 32;
+}
+
+/*
+================================================================================
+                              Random Fields
+================================================================================
+*/
+
+//solve::random draws from the global seed (the srand of this generator), every
+//call gets a stream of its own
+uint64_t seed = 0;
+std::atomic<uint64_t> streams(0);
+
+void setSeed(uint64_t _seed){
+  seed = _seed;
+  streams = 0;
+}
+
+//End of namespace
+}
@@ -0,0 +1,94 @@
+/*
+================================================================================
+                          Coarse-to-Fine Pipeline
+================================================================================
+*/
+
+//A model is integrated on a sequence of grids of growing size. Every level is
+//a Solver of its own, which starts from the fields of the previous level
+//sampled up to its size and runs its own number of steps. The long early
+//dynamics are run where they are cheap, the fine levels only add the detail.
+//
+//The integrator is called on grids of every size, so it should take sizes
+//from solve::grid() and not from the model.
+
+namespace solve{
+
+template<typename Model, typename Scalar = complex>
+class Pipeline{
+public:
+  typedef Solver<Model, Scalar> Stage;
+  typedef typename Stage::Fields Fields;
+
+  //Schedule
+  void add(glm::vec2 _dim, int _steps, double _timeStep);   //Append a level (0 steps only transfers)
+  std::vector<Sampling> sampling;   //Transfer of every field between levels (default BICUBIC)
+
+  //Run every level from the initial fields (of any size), returns the last level
+  Stage& run(Model &model, const Fields &initial, glm::vec2 _dim,
+             typename Stage::Integrator integrator, typename Stage::Method _inte);
+
+  std::vector<Stage> levels;
+
+private:
+  Fields transfer(const Fields &fields, glm::vec2 from, glm::vec2 to);
+};
+
+template<typename Model, typename Scalar>
+void Pipeline<Model, Scalar>::add(glm::vec2 _dim, int _steps, double _timeStep){
+  levels.emplace_back();
+  Stage &level = levels.back();
+  level.setup("Level "+std::to_string(levels.size()-1), _dim, _timeStep);
+
+  //Negative steps make a solver run without end, a level has to finish
+  if(_steps < 0){
+    std::cout<<"Pipeline level "<<levels.size()-1<<" needs a step count of 0 or more, got "<<_steps<<". Running 0 steps."<<std::endl;
+    _steps = 0;
+  }
+  level.steps = _steps;
+}
+
+template<typename Model, typename Scalar>
+typename Pipeline<Model, Scalar>::Fields Pipeline<Model, Scalar>::transfer(const Fields &fields, glm::vec2 from, glm::vec2 to){
+  Fields sampled(fields.size());
+  for(unsigned int i = 0; i < fields.size(); i++){
+    Sampling method = (i < sampling.size())?sampling[i]:BICUBIC;
+    sampled[i] = (from == to)?fields[i]:sample(fields[i], from, to, method);
+  }
+  return sampled;
+}
+
+template<typename Model, typename Scalar>
+typename Pipeline<Model, Scalar>::Stage& Pipeline<Model, Scalar>::run(Model &model, const Fields &initial, glm::vec2 _dim,
+                                                                      typename Stage::Integrator integrator, typename Stage::Method _inte){
+  if(levels.empty()){
+    std::cout<<"Pipeline has no levels."<<std::endl;
+    levels.emplace_back();
+    levels.back().setup("Level 0", _dim, 0.0);
+    levels.back().fields = initial;
+    return levels.back();
+  }
+
+  const Fields* previous = &initial;
+  glm::vec2 from = _dim;
+  double time = 0.0;
+
+  for(Stage &level: levels){
+    level.fields = transfer(*previous, from, level.dim);
+    level.integrator = integrator;
+    level.time = time;
+
+    //The solver counts its remaining steps down
+    while(level.steps > 0){
+      level.step(model, _inte);
+    }
+
+    previous = &level.fields;
+    from = level.dim;
+    time = level.time;
+  }
+  return levels.back();
+}
+
+//End of namespace
+}
@@ -0,0 +1,304 @@
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <atomic>
+
+/*
+================================================================================
+                          Coupled Solver Scheduling
+================================================================================
+*/
+
+//Coupled models are stepped together, one tick at a time. Fields of other
+//solvers are read through double-buffered snapshots of the last tick, so a
+//reader never waits for the solver that owns the field. Only writes into the
+//fields of another solver order the steps within a tick.
+
+namespace solve{
+
+//Snapshots are published by the scheduler, independent of the field type
+class Shared{
+public:
+  virtual ~Shared(){}
+  virtual void copy() = 0;    //Copy the live field into the back buffer
+  virtual void swap() = 0;    //Make the back buffer visible to the readers
+};
+
+//Field of another solver, as it was at the end of the last tick
+template<typename T>
+class Snapshot: public Shared{
+public:
+  Snapshot(std::vector<Array<T>> &_fields, int _index);
+
+  const Array<T>& operator()() const;
+  void copy();
+  void swap();
+
+private:
+  std::vector<Array<T>>* fields;  //Fields of the owning solver (they may be replaced)
+  int index;
+  Array<T> buffers[2];
+  int front = 0;
+};
+
+template<typename T>
+Snapshot<T>::Snapshot(std::vector<Array<T>> &_fields, int _index){
+  fields = &_fields;
+  index = _index;
+  buffers[0] = (*fields)[index];
+  buffers[1] = buffers[0];
+}
+
+template<typename T>
+const Array<T>& Snapshot<T>::operator()() const{
+  return buffers[front];
+}
+
+template<typename T>
+void Snapshot<T>::copy(){
+  buffers[1-front] = (*fields)[index];
+}
+
+template<typename T>
+void Snapshot<T>::swap(){
+  front = 1-front;
+}
+
+/*
+================================================================================
+                                 Thread Pool
+================================================================================
+*/
+
+class Pool{
+public:
+  ~Pool();
+
+  void start(int n);                        //Spawn the workers (once)
+  void run(std::function<void()> job);      //Queue a job, jobs may queue more jobs
+  void wait();                              //Block until all jobs are done
+
+private:
+  void work();
+
+  std::vector<std::thread> threads;
+  std::deque<std::function<void()>> jobs;
+  std::mutex lock;
+  std::condition_variable ready;            //New jobs or quit
+  std::condition_variable done;             //Queue drained and nobody busy
+  int busy = 0;
+  bool quit = false;
+};
+
+Pool::~Pool(){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+  ready.notify_all();
+  for(auto &t: threads){
+    t.join();
+  }
+}
+
+void Pool::start(int n){
+  if(!threads.empty()){
+    return;
+  }
+  for(int i = 0; i < n; i++){
+    threads.emplace_back(&Pool::work, this);
+  }
+}
+
+void Pool::run(std::function<void()> job){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    jobs.push_back(job);
+  }
+  ready.notify_one();
+}
+
+void Pool::wait(){
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this]{ return jobs.empty() && busy == 0; });
+}
+
+void Pool::work(){
+  while(true){
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      ready.wait(guard, [this]{ return quit || !jobs.empty(); });
+      if(quit && jobs.empty()){
+        return;
+      }
+      job = jobs.front();
+      jobs.pop_front();
+      busy++;
+    }
+
+    job();
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      busy--;
+      if(jobs.empty() && busy == 0){
+        done.notify_all();
+      }
+    }
+  }
+}
+
+/*
+================================================================================
+                                  Scheduler
+================================================================================
+*/
+
+class Scheduler{
+public:
+  Scheduler(int _threads = 0);   //0: one thread per solver
+
+  //Add a solver with its model and integration method, returns its task
+  template<typename Model, typename Scalar>
+  int add(Model &model, Solver<Model, Scalar> &solver, typename Solver<Model, Scalar>::Method _inte);
+
+  //Declare Couplings
+  template<typename Model, typename Scalar>
+  const Snapshot<Scalar>& reads(int task, Solver<Model, Scalar> &source, int field);   //Task reads a field of another solver
+  bool writes(int task, int source);                                                  //Task writes fields of another solver
+
+  //Step all solvers once / n times
+  void step();
+  void integrate(int steps);
+
+private:
+  struct Task{
+    std::function<void()> step;
+    void* solver;                   //Owner of the fields (to resolve reads)
+    std::vector<int> after;         //Tasks that have to step first
+    std::vector<int> before;        //Tasks that wait for this one
+    std::vector<Shared*> shared;    //Snapshots of our fields
+  };
+
+  void run(int task);               //Step a task and release the ones waiting for it
+  void finish(int task);            //Publish the fields once nobody writes them anymore
+  bool reaches(int from, int to);   //There is an ordering path between two tasks
+
+  std::vector<Task> tasks;
+  std::vector<std::unique_ptr<Shared>> snapshots;
+  std::unique_ptr<std::atomic<int>[]> waiting;  //Unfinished tasks each task waits for
+  std::unique_ptr<std::atomic<int>[]> pending;  //Unfinished writers of each tasks fields
+  int threads;
+  Pool pool;
+};
+
+Scheduler::Scheduler(int _threads){
+  threads = _threads;
+}
+
+template<typename Model, typename Scalar>
+int Scheduler::add(Model &model, Solver<Model, Scalar> &solver, typename Solver<Model, Scalar>::Method _inte){
+  Task task;
+  task.step = [&model, &solver, _inte](){ solver.step(model, _inte); };
+  task.solver = &solver;
+  tasks.push_back(task);
+  return tasks.size()-1;
+}
+
+template<typename Model, typename Scalar>
+const Snapshot<Scalar>& Scheduler::reads(int task, Solver<Model, Scalar> &source, int field){
+  //Find the task that owns the field
+  int owner = -1;
+  for(unsigned int i = 0; i < tasks.size(); i++){
+    if(tasks[i].solver == &source) owner = i;
+  }
+
+  Snapshot<Scalar>* snapshot = new Snapshot<Scalar>(source.fields, field);
+  snapshots.emplace_back(snapshot);
+  if(owner < 0){
+    //Not stepped by us, the snapshot just stays as it is
+    std::cout<<"Read from a solver that is not scheduled, the snapshot is never updated."<<std::endl;
+  }
+  else tasks[owner].shared.push_back(snapshot);
+  return *snapshot;
+}
+
+bool Scheduler::writes(int task, int source){
+  //Writing into a field that already orders before us would deadlock
+  if(task == source || reaches(task, source)){
+    std::cout<<"Cyclic write dependency, ignored."<<std::endl;
+    return false;
+  }
+  tasks[task].after.push_back(source);
+  tasks[source].before.push_back(task);
+  return true;
+}
+
+bool Scheduler::reaches(int from, int to){
+  for(int next: tasks[from].before){
+    if(next == to || reaches(next, to)) return true;
+  }
+  return false;
+}
+
+void Scheduler::step(){
+  int n = tasks.size();
+  pool.start((threads > 0)?threads:n);
+
+  //Reset the counters of this tick
+  waiting.reset(new std::atomic<int>[n]);
+  pending.reset(new std::atomic<int>[n]);
+  for(int i = 0; i < n; i++){
+    waiting[i] = tasks[i].after.size();
+    pending[i] = 1+tasks[i].before.size();
+  }
+
+  //Start everything that doesn't wait, the rest follows
+  for(int i = 0; i < n; i++){
+    if(tasks[i].after.empty()){
+      pool.run([this, i](){ run(i); });
+    }
+  }
+  pool.wait();
+
+  //Readers see this tick from now on
+  for(auto &snapshot: snapshots){
+    snapshot->swap();
+  }
+}
+
+void Scheduler::integrate(int steps){
+  for(int i = 0; i < steps; i++){
+    step();
+  }
+}
+
+void Scheduler::run(int task){
+  tasks[task].step();
+
+  //Our own fields, and the fields we wrote into
+  finish(task);
+  for(int source: tasks[task].after){
+    finish(source);
+  }
+
+  //Release the tasks that waited for us
+  for(int next: tasks[task].before){
+    if(--waiting[next] == 0){
+      pool.run([this, next](){ run(next); });
+    }
+  }
+}
+
+void Scheduler::finish(int task){
+  if(--pending[task] == 0){
+    for(Shared* snapshot: tasks[task].shared){
+      snapshot->copy();
+    }
+  }
+}
+
+//End of namespace
+}
@@ -1,16 +1,32 @@
-#include <valarray>
 #include <vector>
 #include <complex>
 #include <glm/glm.hpp>
 #include <fftw.h>
+#include <rfftw.h>
+#include <fftw_threads.h>
+#include <rfftw_threads.h>
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <memory>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std::complex_literals;
 const double PI = 3.141592653589793238460;
 
 typedef std::complex<double> complex;
-typedef std::valarray<complex> CArray;
-typedef std::valarray<bool> BArray;
 
 /*
 ================================================================================
@@ -18,53 +34,64 @@ typedef std::valarray<bool> BArray;
 ================================================================================
 */
 
-//Complex Comparison
+//Complex Comparison (only the real part counts)
 bool operator < (const complex& lhs, const complex& rhs){ return lhs.real() < rhs.real(); }
 bool operator > (const complex& lhs, const complex& rhs){ return rhs < lhs; }
 bool operator <= (const complex& lhs, const complex& rhs){ return !(lhs > rhs); }
 bool operator >= (const complex& lhs, const complex& rhs){ return !(lhs < rhs); }
+bool equal(const complex& lhs, const complex& rhs){ return lhs.real() == rhs.real(); }
 
-//Boolean Arrays for Masking
-BArray operator < (const CArray& lhs, const CArray &rhs){
-  BArray b (lhs.size());
-  for(unsigned int i = 0; i < lhs.size(); i++){
-    b[i] = lhs[i] < rhs[i];
-  }
-  return b;
-}
+/*
+================================================================================
+                                  Threading
+================================================================================
+*/
 
-BArray operator > (const CArray& lhs, const CArray &rhs){
-  BArray b (lhs.size());
-  for(unsigned int i = 0; i < lhs.size(); i++){
-    b[i] = lhs[i] > rhs[i];
-  }
-  return b;
+namespace solve{
+
+//Default to every core we are allowed to use (OMP_NUM_THREADS is respected)
+int defaultThreads(){
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return std::max(1, (int)std::thread::hardware_concurrency());
+#endif
 }
 
-std::valarray<bool> operator > (const CArray& lhs, const complex& rhs){
-  std::valarray<bool> b (lhs.size());
-  for(unsigned int i = 0; i < lhs.size(); i++){
-    b[i] = lhs[i] > rhs;
-  }
-  return b;
+int nthreads = defaultThreads();  //Threads used by the transforms and all helpers
+int grain = 16384;                //Grids with fewer points stay on one thread
+bool fftwThreads = false;         //FFTW threads have been initialized
+
+void setThreads(int n){
+  nthreads = std::max(1, n);
 }
 
-std::valarray<bool> operator < (const CArray& lhs, const complex& rhs){
-  std::valarray<bool> b (lhs.size());
-  for(unsigned int i = 0; i < lhs.size(); i++){
-    b[i] = lhs[i] < rhs;
-  }
-  return b;
+//Number of threads worth using for N points of work
+int workers(int N){
+  return (N < grain)?1:nthreads;
 }
 
-std::valarray<bool> operator == (const CArray& lhs, const complex& rhs){
-  std::valarray<bool> b (lhs.size());
-  for(unsigned int i = 0; i < lhs.size(); i++){
-    b[i] = lhs[i].real() == rhs.real();
-  }
-  return b;
 }
 
+//Lazy field arrays (valarray interface, fused expressions)
+#include "array.h"
+
+//Counter-based random numbers (reproducible on any number of threads)
+#include "philox.h"
+
+//Field Storage Types (real fields only need real storage)
+typedef Array<complex> CArray;
+typedef Array<double> RArray;
+typedef Array<float> FArray;
+typedef Array<bool> BArray;
+typedef Array<int> IArray;
+
+//Storage type of an Array or Array expression (e.g. a - b)
+template<typename E> using ArrayOf = Array<typename E::value_type>;
+
+//Set of same-sized fields to work on together
+template<typename T> using Span = std::vector<Array<T>*>;
+
 /*
 ================================================================================
                                 Solver Functions
@@ -74,36 +101,265 @@ std::valarray<bool> operator == (const CArray& lhs, const complex& rhs){
 //Here are all helper functions for doing math with
 namespace solve{
 
-//Holds the Gridsize currently being worked on
-glm::vec2 modes;
+//Grid Context (bound per thread, a Solver binds its own while stepping)
+struct Grid;
+Grid& grid();                           //Grid the helpers currently work on
+void bind(Grid &_grid);                 //Work on a grid owned by someone else
+void bind(glm::vec2 _modes);            //Work on this threads own grid of a given size
+struct Scope;                           //Binds a grid until the end of the scope
 
 //Index and Vector Conversions on Grid
-int ind(glm::vec2 _p);                  //Use the Modes Size
+int ind(glm::vec2 _p);                  //Use the Grid Size
 int ind(glm::vec2 _p, glm::vec2 _s);    //Use a custom Size
-glm::vec2 pos(int ind);
+glm::vec2 pos(int ind);                 //Use the Grid Size
+glm::vec2 pos(int ind, glm::vec2 _s);   //Use a custom Size
+glm::vec2 freq(int ind, bool half);     //Signed wavenumber of a (half-)spectrum coefficient
 
-//Construction Helpers
-std::vector<CArray> emptyArray(unsigned int size);    //Fill vector of CArrays with zeros
-CArray fromArray(float a[]);                          //Fill CArray from Array
-CArray random(double high, double low);
+//Construction Helpers (default to complex storage)
+template<typename T = complex> std::vector<Array<T>> emptyArray(unsigned int size);  //Fill vector of Arrays with zeros
+template<typename T = complex> Array<T> fromArray(float a[]);                        //Fill Array from Array
+template<typename T = complex> Array<T> random(double high, double low);                                           //Uniform, next stream of the global seed
+template<typename T = complex> Array<T> uniform(uint64_t _seed, double low = 0.0, double high = 1.0, uint64_t stream = 0);  //Uniform field of a seed
+template<typename T = complex> Array<T> normal(uint64_t _seed, double mean = 0.0, double sigma = 1.0, uint64_t stream = 0); //Normal field of a seed
+IArray integers(uint64_t _seed, int low, int high, uint64_t stream = 0);                                          //Integer field in [low, high)
+
+//Spectral Boundary (complex buffers only exist here)
+template<typename T> CArray toComplex(const Array<T> &field);   //Promote to complex for transforms
+template<typename T> Array<T> fromComplex(const CArray &coef);  //Demote back to storage type
+template<typename T> constexpr bool half();                     //Real fields use the half-spectrum
+template<typename T> CArray forward(const Array<T> &field);     //rfft for real fields, fft for complex
+template<typename T> Array<T> backward(const CArray &coef);     //irfft for real fields, ifft for complex
+template<typename T> std::vector<CArray> forward(const Span<T> &fields);           //Batched forward
+template<typename T> std::vector<Array<T>> backward(const std::vector<CArray> &coefs);  //Batched backward
 
 //Solver Term Helpers
-CArray diff(CArray field, int x, int y);              //Differential Real space, degree x and y
-CArray fdiff(CArray field, int x, int y);             //Differential Fourier space, degree x and y
-CArray abs(CArray field);                             //Negative values become positive
-CArray scale(CArray field, double a, double b);       //Linear Scale between a, b
-CArray roll(CArray field, glm::vec2 offset);          //Offset everything by a fixed amount
-CArray shift(CArray field, CArray x, CArray y);       //Offset everything by a specific amount
-CArray diffuse(CArray field, double mu, int cycles);  //Returns a diffusion passed CArray
-CArray clamp(CArray field, double low, double high);  //Clamps the values between two values
+template<typename E> ArrayOf<E> diff(const E &field, int x, int y);                                  //Differential Real space, degree x and y
+CArray fdiff(CArray field, int x, int y, bool half = false);                                         //Differential Fourier space, degree x and y
+template<typename E> ArrayOf<E> abs(const E &field);                                                 //Negative values become positive
+template<typename E> ArrayOf<E> scale(const E &field, double a, double b);                           //Linear Scale between a, b
+template<typename E> ArrayOf<E> roll(const E &field, glm::vec2 offset);                              //Offset everything by a fixed amount
+template<typename T> void rollInPlace(Array<T> &field, glm::vec2 offset);                            //Same, without a new array
+template<typename E> ArrayOf<E> shift(const E &field, const ArrayOf<E> &x, const ArrayOf<E> &y);     //Offset everything by a specific amount
+template<typename E> ArrayOf<E> diffuse(const E &field, double mu, int cycles);                      //Returns a diffusion passed Array
+CArray fdiffuse(CArray coef, double mu, int cycles, bool half = false);                              //Diffusion in Fourier space
+CArray flaplace(CArray coef, bool half = false);                                                     //Laplacian in Fourier space
+template<typename E> ArrayOf<E> clamp(const E &field, double low, double high);                      //Clamps the values between two values
+
+//Batched Term Helpers (one transform for all fields)
+template<typename T> std::vector<Array<T>> diff(const Span<T> &fields, int x, int y);   //Differentials of every field
+template<typename T> void diffuse(const Span<T> &fields, double mu, int cycles);        //Diffuses every field in place
+
+//Spectral Operator Tables (cached per grid size and layout)
+struct Spectrum;
+Spectrum& spectrum(bool half);                                  //Wavenumber tables of the current grid
+const CArray& derivative(int x, int y, bool half);              //Multiplier of the (x, y)-th derivative
+const RArray& diffusion(double mu, int cycles, bool half);      //Exact diffusion factor exp(-mu*k²*cycles)
+const RArray& implicit(double rate, bool half);                 //Backward euler diffusion factor 1/(1+rate*k²)
+const RArray& phi(int order, double rate, bool half);           //Exponential integrator function phi_n(-rate*k²)
+void multiply(CArray &coef, const RArray &factor);              //Apply a real multiplier
+
+//Connected Areas (cells of equal value, 4 or 8 neighbors, wrapping around the grid)
+struct Component;
+template<typename E> IArray components(const E &field, std::vector<Component> &stats, int connectivity = 4, bool periodic = true);
+int findRoot(std::vector<int> &parent, int i);    //Union-find root with path halving
+void unite(std::vector<int> &parent, int a, int b);
+
+//Per-Label Statistics (one sweep for any number of fields)
+template<typename T> struct Reduction;
+template<typename T> Reduction<T> reduceByLabel(const IArray &labels, int nlabels, const Span<T> &fields);
+
+//FFT Plan Cache
+struct Plan;
+Plan& plan(fftw_direction dir, bool real = false);   //Cached plan of the grid for a direction
+bool loadWisdom();                                    //Import FFTW wisdom from disk
+bool saveWisdom();                                    //Export FFTW wisdom to disk (also done at exit)
+void clearPlans();                                    //Destroy the cached plans and buffers of the grid
+void reserve(Plan &_plan, int howmany);               //Grow the buffers for batched transforms
 
 //Complex Operations
-CArray fft(CArray coef);                                            //Fourier Transform
-CArray ifft(CArray coef);                                           //Inverse Fourier Transform
-CArray label(CArray field, int &nareas);                            //Returns label array by value
-CArray convolve(CArray field, CArray kernel, glm::vec2 ksize);      //Returns the kernel convolved
-float autothresh(CArray height, float start, float fraction);       //Auto Thresholder
-CArray sample(CArray field, glm::vec2 oldSize, glm::vec2 newSize);  //Return a higher resolution grid
+CArray fft(CArray coef);                                                                //Fourier Transform
+CArray ifft(CArray coef);                                                               //Inverse Fourier Transform
+template<typename T> CArray rfft(const Array<T> &field);                                //Real to Half-Spectrum Transform
+template<typename T> Array<T> irfft(CArray coef);                                       //Half-Spectrum to Real Transform
+
+//Batched Complex Operations (same-sized fields, one call)
+std::vector<CArray> fft(const Span<complex> &fields);                                   //Batched Fourier Transform
+std::vector<CArray> ifft(const std::vector<CArray> &coefs);                             //Batched Inverse Fourier Transform
+template<typename T> std::vector<CArray> rfft(const Span<T> &fields);                   //Batched Real to Half-Spectrum
+template<typename T> std::vector<Array<T>> irfft(const std::vector<CArray> &coefs);     //Batched Half-Spectrum to Real
+template<typename E> ArrayOf<E> label(const E &field, int &nareas);                                       //Returns label array of the connected areas
+template<typename E> ArrayOf<E> convolve(const E &field, const ArrayOf<E> &kernel, glm::vec2 ksize);      //Returns the kernel convolved (see kernel.h)
+template<typename E> float autothresh(const E &height, float start, float fraction);                      //Level with a fraction of the field above it (exact)
+template<typename E> std::vector<double> ranked(const E &field, const std::vector<long> &ranks);          //Values of the given ranks in ascending order
+template<typename E> std::vector<double> quantiles(const E &field, const std::vector<double> &q);          //Quantiles (interpolated between ranks)
+
+//Resampling (periodic, new points keep their relative position, downsampling filters the field first)
+enum Sampling{ SPECTRAL, BILINEAR, BICUBIC, NEAREST };   //NEAREST keeps values (labels)
+struct Resampling;
+Resampling resampling(int n, int m, Sampling method);                                 //Interpolation weights of one axis
+double cubic(double x);                                                               //Keys cubic convolution weight (a = -0.5)
+std::vector<std::tuple<int, int, double>> refold(int n, int m);                       //Old mode, new mode and weight of one axis
+template<typename E> ArrayOf<E> sample(const E &field, glm::vec2 oldSize, glm::vec2 newSize, Sampling method = BICUBIC);  //Return the field on a grid of another size
+
+//Semi-Lagrangian Advection (the gather plan is built once and applied to any number of fields)
+struct Advection;
+template<typename E> Advection advection(const E &x, const E &y, Sampling method = BILINEAR);   //Every cell takes its value from its position + (x, y) cells
+template<typename E> void advection(Advection &plan, const E &x, const E &y, Sampling method = BILINEAR);  //Same, reusing the buffers of a plan
+template<typename E> ArrayOf<E> advect(const E &field, const Advection &plan);                 //Interpolated values at the departure points
+
+/*
+================================================================================
+                                Grid Context
+================================================================================
+*/
+
+//Spectral operator tables of one layout (full or half-spectrum)
+struct Spectrum{
+  RArray kx, ky;                                    //Angular wavenumbers (2*PI*k)
+  RArray k2;                                        //Squared magnitude
+  RArray laplacian;                                 //Laplacian multiplier (-k²)
+  std::map<std::pair<int, int>, CArray> derivative; //Derivative multipliers by order
+  std::map<double, RArray> diffusion;               //Diffusion factors by mu*cycles
+  std::map<double, RArray> implicit;                //Implicit diffusion factors by rate
+  std::map<std::pair<int, double>, RArray> phi;     //Exponential integrator factors by order and rate
+};
+
+//Size and position of a connected area
+struct Component{
+  int area = 0;           //Number of cells
+  glm::vec2 centroid;     //Mean position (circular mean on periodic grids)
+  glm::vec2 lower;        //Bounding box corners (periodic grids: cells unwrapped around
+  glm::vec2 upper;        //the centroid, so the box may reach off the grid)
+};
+
+//Statistics of fields over the cells of every label
+template<typename T>
+struct Reduction{
+  std::vector<int> count;                 //Cells with the label
+  std::vector<Array<T>> sum, min, max;    //By field, then by label
+  Array<T> mean(int field) const;
+};
+
+//Interpolation weights of one axis, every new point has the same number of taps
+struct Resampling{
+  int taps;
+  std::vector<int> index;       //Old points (taps per new point)
+  std::vector<double> weight;
+};
+
+//Departure points of every cell, as separable interpolation taps (taps per cell and axis)
+struct Advection{
+  int taps;                       //2 (bilinear) or 4 (bicubic)
+  std::vector<int> x, y;          //Row offsets (x*ny) and columns
+  std::vector<double> wx, wy;     //Their weights
+};
+
+//FFTW plan with its own transform buffers
+struct Plan{
+  fftwnd_plan p;
+  bool real;            //Real transforms work on the half-spectrum
+  fftw_complex* buf;    //Aligned heap buffer of the spectrum size (planning / scratch)
+  fftw_real* rbuf;      //Aligned heap buffer of the grid size (real transforms only)
+  int N;                //Grid points
+  int M;                //Spectral coefficients
+  int capacity;         //Number of fields the buffers hold (batched transforms)
+};
+
+//Everything the helpers need to know about the grid they work on. Caches are
+//owned by the grid, so solvers on different threads never share state.
+struct Grid{
+  Grid(glm::vec2 _modes = glm::vec2(0));
+  Grid(const Grid &other);                //Copies the size, not the caches
+  Grid& operator=(const Grid &other);
+  ~Grid();
+
+  void resize(glm::vec2 _modes);          //Change the size and drop the caches
+  void clear();                           //Destroy the cached plans and tables
+
+  glm::vec2 modes;      //Size of the grid
+  int N;                //Grid points
+  int stride;           //Index offset of one step in x (one step in y is 1)
+
+  std::map<bool, Spectrum> spectra;                         //Operator tables by layout
+  std::map<std::pair<int, bool>, Plan> plans;               //FFT plans by direction and layout
+  std::shared_ptr<char> token = std::make_shared<char>();    //Replaced when the caches go, kernels keep their spectra by it
+};
+
+//FFTW planning shares global state, only one thread may plan at a time
+std::mutex planning;
+
+//The grid of helper calls outside of a solver, and the one currently bound
+thread_local Grid local;
+thread_local Grid* context = &local;
+
+//Grids that spectral resampling transforms on, by size
+thread_local std::map<std::pair<int, int>, Grid> samplers;
+
+Grid::Grid(glm::vec2 _modes){
+  modes = _modes;
+  N = modes.x*modes.y;
+  stride = modes.y;
+}
+
+Grid::Grid(const Grid &other):Grid(other.modes){}
+
+Grid& Grid::operator=(const Grid &other){
+  resize(other.modes);
+  return *this;
+}
+
+Grid::~Grid(){
+  clear();
+}
+
+void Grid::resize(glm::vec2 _modes){
+  if(_modes == modes){
+    return;
+  }
+  clear();
+  modes = _modes;
+  N = modes.x*modes.y;
+  stride = modes.y;
+}
+
+void Grid::clear(){
+  spectra.clear();
+  token = std::make_shared<char>();
+  if(plans.empty()){
+    return;
+  }
+  std::lock_guard<std::mutex> lock(planning);
+  for(auto &_plan: plans){
+    if(_plan.second.real) rfftwnd_destroy_plan(_plan.second.p);
+    else fftwnd_destroy_plan(_plan.second.p);
+    free(_plan.second.buf);
+    free(_plan.second.rbuf);
+  }
+  plans.clear();
+}
+
+Grid& grid(){
+  return *context;
+}
+
+void bind(Grid &_grid){
+  context = &_grid;
+}
+
+void bind(glm::vec2 _modes){
+  local.resize(_modes);
+  context = &local;
+}
+
+struct Scope{
+  Scope(Grid &_grid):previous(context){
+    context = &_grid;
+  }
+  ~Scope(){
+    context = previous;
+  }
+  Grid* previous;
+};
 
 /*
 ================================================================================
@@ -112,12 +368,7 @@ CArray sample(CArray field, glm::vec2 oldSize, glm::vec2 newSize);  //Return a h
 */
 
 int ind(glm::vec2 _p){
-  //Return the Correct Index
-  _p = glm::mod(_p+modes, modes);
-  if(glm::all(glm::lessThan(_p, modes)) && glm::all(glm::greaterThanEqual(_p, glm::vec2(0)))){
-    return _p.x*modes.y+_p.y;
-  }
-  return 0;
+  return ind(_p, grid().modes);
 }
 
 int ind(glm::vec2 _p, glm::vec2 _s){
@@ -131,141 +382,614 @@ int ind(glm::vec2 _p, glm::vec2 _s){
 
 
 glm::vec2 pos(int ind){
-  int _x = ind/modes.y;
-  int _y = ind-modes.y*_x;
+  return pos(ind, grid().modes);
+}
+
+glm::vec2 pos(int ind, glm::vec2 _s){
+  int _x = ind/_s.y;
+  int _y = ind-_s.y*_x;
   //Return Binary Vectory
   return glm::vec2(_x, _y);
 }
 
+glm::vec2 freq(int ind, bool half){
+  glm::vec2 modes = grid().modes;
+  //The half-spectrum only stores the non-negative y frequencies
+  int ny = (half)?(int)modes.y/2+1:(int)modes.y;
+  int _x = ind/ny;
+  int _y = ind-ny*_x;
+  //Upper half of the spectrum are the negative frequencies
+  if(_x > modes.x/2) _x -= modes.x;
+  if(!half && _y > modes.y/2) _y -= modes.y;
+  return glm::vec2(_x, _y);
+}
+
 /*
 ================================================================================
                             Construction Helpers
 ================================================================================
 */
 
-std::vector<CArray> emptyArray(unsigned int size){
+template<typename T>
+std::vector<Array<T>> emptyArray(unsigned int size){
   //Add blank fields to delta
-  std::vector<CArray> delta;
-  CArray zero(0.0, modes.x*modes.y);
+  std::vector<Array<T>> delta;
+  Array<T> zero((T)0.0, grid().N);
   delta.assign(size, zero);
   return delta;
 }
 
-CArray fromArray(float a[]){  //Constrct field from flat array
+template<typename T>
+Array<T> fromArray(float a[]){  //Constrct field from flat array
   //Set the Data
-  CArray coef(0.0, modes.x*modes.y);
-  for(int i = 0; i < modes.x*modes.y; i++){
+  Array<T> coef((T)0.0, grid().N);
+  #pragma omp parallel for num_threads(workers(coef.size()))
+  for(unsigned int i = 0; i < coef.size(); i++){
     //Generate Blank Vector
-    complex _coef = a[i];
-    coef[i] = _coef;
+    coef[i] = (T)a[i];
   }
   return coef;
 }
 
-CArray random(double high, double low){
-  CArray coef(0.0, modes.x*modes.y);
-  for(int i = 0; i < modes.x*modes.y; i++){
-    //Generate Blank Vector
-    coef[i] = ((double)(rand()%1000000)/1000000)*(high-low)+low;
+template<typename T>
+Array<T> random(double high, double low){
+  return uniform<T>(seed, low, high, streams++);
+}
+
+template<typename T>
+Array<T> uniform(uint64_t _seed, double low, double high, uint64_t stream){
+  //Every cell draws from its own index, the thread count doesn't matter
+  Philox rng(_seed, stream);
+  Array<T> coef(grid().N);
+  #pragma omp parallel for num_threads(workers(coef.size()))
+  for(unsigned int i = 0; i < coef.size(); i++){
+    coef[i] = (T)(rng.uniform(i)*(high-low)+low);
+  }
+  return coef;
+}
+
+template<typename T>
+Array<T> normal(uint64_t _seed, double mean, double sigma, uint64_t stream){
+  Philox rng(_seed, stream);
+  Array<T> coef(grid().N);
+  #pragma omp parallel for num_threads(workers(coef.size()))
+  for(unsigned int i = 0; i < coef.size(); i++){
+    coef[i] = (T)(rng.normal(i)*sigma+mean);
+  }
+  return coef;
+}
+
+IArray integers(uint64_t _seed, int low, int high, uint64_t stream){
+  if(high <= low){
+    std::cout<<"Empty integer range ["<<low<<", "<<high<<"), returning "<<low<<"."<<std::endl;
+    return IArray(low, grid().N);
+  }
+  Philox rng(_seed, stream);
+  IArray coef(grid().N);
+  const uint32_t n = (int64_t)high-low;     //Can exceed the int range
+  #pragma omp parallel for num_threads(workers(coef.size()))
+  for(unsigned int i = 0; i < coef.size(); i++){
+    coef[i] = (int64_t)low+rng.integer(i, n);
   }
   return coef;
 }
 
 /*
 ================================================================================
-                              Solver Term Helpers
+                              Spectral Boundary
 ================================================================================
 */
 
-CArray roll(CArray field, glm::vec2 offset){
-  //New Array
-  CArray coef(0.0, modes.x*modes.y);
-  //Loop over the Field
+template<typename T>
+CArray toComplex(const Array<T> &field){
+  //Promote the real field
+  CArray coef(0.0, field.size());
+  #pragma omp parallel for num_threads(workers(field.size()))
   for(unsigned int i = 0; i < field.size(); i++){
-    int projected = (int)(ind(pos(i)+offset)+modes.x*modes.y)%(int)(modes.x*modes.y);
-    coef[i] = field[projected];
+    coef[i] = (double)field[i];
+  }
+  return coef;
+}
+
+template<>
+CArray toComplex<complex>(const CArray &field){
+  return field;
+}
+
+template<typename T>
+Array<T> fromComplex(const CArray &coef){
+  //Keep only the real part
+  Array<T> field((T)0.0, coef.size());
+  #pragma omp parallel for num_threads(workers(coef.size()))
+  for(unsigned int i = 0; i < coef.size(); i++){
+    field[i] = (T)coef[i].real();
+  }
+  return field;
+}
+
+template<>
+CArray fromComplex<complex>(const CArray &coef){
+  return coef;
+}
+
+template<typename T>
+constexpr bool half(){
+  return !std::is_same<T, complex>::value;
+}
+
+template<typename T>
+CArray forward(const Array<T> &field){
+  return rfft(field);
+}
+
+template<>
+CArray forward<complex>(const CArray &field){
+  return fft(field);
+}
+
+template<typename T>
+Array<T> backward(const CArray &coef){
+  return irfft<T>(coef);
+}
+
+template<>
+CArray backward<complex>(const CArray &coef){
+  return ifft(coef);
+}
+
+template<typename T>
+std::vector<CArray> forward(const Span<T> &fields){
+  return rfft(fields);
+}
+
+template<>
+std::vector<CArray> forward<complex>(const Span<complex> &fields){
+  return fft(fields);
+}
+
+template<typename T>
+std::vector<Array<T>> backward(const std::vector<CArray> &coefs){
+  return irfft<T>(coefs);
+}
+
+template<>
+std::vector<CArray> backward<complex>(const std::vector<CArray> &coefs){
+  return ifft(coefs);
+}
+
+/*
+================================================================================
+                          Spectral Operator Tables
+================================================================================
+*/
+
+//Wavenumbers and operator multipliers only depend on the grid, so they are
+//computed once per grid and spectral operators become a single multiply.
+
+Spectrum& spectrum(bool half){
+  Grid& _g = grid();
+  auto found = _g.spectra.find(half);
+  if(found != _g.spectra.end()){
+    return found->second;
+  }
+
+  //Fill the Wavenumber Tables
+  Spectrum& _s = _g.spectra[half];
+  int M = (half)?_g.modes.x*((int)_g.modes.y/2+1):_g.N;
+  _s.kx.resize(M);
+  _s.ky.resize(M);
+  for(int i = 0; i < M; i++){
+    glm::vec2 z = freq(i, half);
+    _s.kx[i] = 2*PI*z.x;
+    _s.ky[i] = 2*PI*z.y;
+  }
+  _s.k2 = _s.kx*_s.kx + _s.ky*_s.ky;
+  _s.laplacian = -_s.k2;
+  return _s;
+}
+
+const CArray& derivative(int x, int y, bool half){
+  Spectrum& _s = spectrum(half);
+  auto found = _s.derivative.find(std::make_pair(x, y));
+  if(found != _s.derivative.end()){
+    return found->second;
+  }
+
+  //Fill the Multiplier
+  glm::vec2 modes = grid().modes;
+  CArray& _d = _s.derivative[std::make_pair(x, y)];
+  _d.resize(_s.kx.size());
+  for(unsigned int i = 0; i < _d.size(); i++){
+    glm::vec2 z = freq(i, half);
+    //Odd derivatives of the nyquist mode are not real
+    if((x%2 == 1 && 2*z.x == modes.x) || (y%2 == 1 && 2*z.y == modes.y)){
+      _d[i] = 0.0;
+      continue;
+    }
+    _d[i] = pow(1.0i*_s.kx[i], x)*pow(1.0i*_s.ky[i], y);
+  }
+  return _d;
+}
+
+const RArray& diffusion(double mu, int cycles, bool half){
+  Spectrum& _s = spectrum(half);
+  double rate = mu*cycles;
+  auto found = _s.diffusion.find(rate);
+  if(found != _s.diffusion.end()){
+    return found->second;
+  }
+
+  //Don't keep every rate ever used
+  if(_s.diffusion.size() > 16){
+    _s.diffusion.clear();
+  }
+  return _s.diffusion[rate] = exp(-rate*_s.k2);
+}
+
+const RArray& implicit(double rate, bool half){
+  Spectrum& _s = spectrum(half);
+  auto found = _s.implicit.find(rate);
+  if(found != _s.implicit.end()){
+    return found->second;
+  }
+
+  if(_s.implicit.size() > 16){
+    _s.implicit.clear();
+  }
+  return _s.implicit[rate] = 1.0/(1.0+rate*_s.k2);
+}
+
+//phi_1(z) = (e^z-1)/z, phi_2(z) = (e^z-1-z)/z², both 1/n! at z = 0
+const RArray& phi(int order, double rate, bool half){
+  Spectrum& _s = spectrum(half);
+  auto found = _s.phi.find(std::make_pair(order, rate));
+  if(found != _s.phi.end()){
+    return found->second;
+  }
+
+  if(_s.phi.size() > 16){
+    _s.phi.clear();
+  }
+  RArray& _p = _s.phi[std::make_pair(order, rate)];
+  _p.resize(_s.k2.size());
+  for(unsigned int i = 0; i < _p.size(); i++){
+    double z = -rate*_s.k2[i];
+    double e = std::expm1(z);
+    if(order == 1){
+      _p[i] = (z == 0.0)?1.0:e/z;
+    }
+    else{
+      //Series below the cancellation
+      _p[i] = (std::abs(z) < 1E-2)?1.0/2.0+z/6.0+z*z/24.0+z*z*z/120.0:(e-z)/(z*z);
+    }
+  }
+  return _p;
+}
+
+void multiply(CArray &coef, const RArray &factor){
+  //Real times complex is two multiplies
+  double* c = reinterpret_cast<double*>(&coef[0]);
+  const double* f = &factor[0];
+  #pragma omp parallel for num_threads(workers(coef.size()))
+  for(unsigned int i = 0; i < coef.size(); i++){
+    c[2*i] *= f[i];
+    c[2*i+1] *= f[i];
+  }
+}
+
+/*
+================================================================================
+                              Solver Term Helpers
+================================================================================
+*/
+
+template<typename E>
+ArrayOf<E> roll(const E &_field, glm::vec2 offset){
+  typedef typename E::value_type T;
+  const ArrayOf<E> &field = _field;   //Only evaluates expressions
+  const int nx = grid().modes.x, ny = grid().modes.y;
+  const int ox = ((int)std::floor(offset.x)%nx+nx)%nx;
+  const int oy = ((int)std::floor(offset.y)%ny+ny)%ny;
+  Array<T> coef(field.size());
+
+  //Every row is a source row rotated by oy, two contiguous copies
+  #pragma omp parallel for num_threads(workers(field.size()))
+  for(int x = 0; x < nx; x++){
+    T* o = &coef[x*ny];
+    const T* f = &field[((x+ox)%nx)*ny];
+    memcpy((void*)o, f+oy, (ny-oy)*sizeof(T));
+    memcpy((void*)(o+ny-oy), f, oy*sizeof(T));
   }
   return coef;
 }
 
-CArray shift(CArray field, CArray x, CArray y){
-  //New Array
-  CArray coef(0.0, modes.x*modes.y);
+template<typename T>
+void rollInPlace(Array<T> &field, glm::vec2 offset){
+  const int nx = grid().modes.x, ny = grid().modes.y;
+  const int ox = ((int)std::floor(offset.x)%nx+nx)%nx;
+  const int oy = ((int)std::floor(offset.y)%ny+ny)%ny;
+
+  //The roll in x moves whole rows along the cycles of r <- r+ox, there are
+  //gcd(nx, ox) of them. Every thread moves its own slice of the columns along
+  //all cycles, with one slice of scratch.
+  T* f = &field[0];
+  if(ox != 0){
+    const int cycles = std::gcd(nx, ox);
+    const int nchunks = std::min(workers(field.size()), ny);
+    #pragma omp parallel for num_threads(nchunks)
+    for(int c = 0; c < nchunks; c++){
+      const int y0 = c*ny/nchunks, y1 = (c+1)*ny/nchunks;
+      std::vector<T> scratch(f+y0, f+y1);
+      for(int s = 0; s < cycles; s++){
+        std::copy(f+s*ny+y0, f+s*ny+y1, scratch.begin());
+        int r = s;
+        for(int next = (r+ox)%nx; next != s; next = (r+ox)%nx){
+          std::copy(f+next*ny+y0, f+next*ny+y1, f+r*ny+y0);
+          r = next;
+        }
+        std::copy(scratch.begin(), scratch.end(), f+r*ny+y0);
+      }
+    }
+  }
+  if(oy == 0) return;
+  #pragma omp parallel for num_threads(workers(field.size()))
+  for(int x = 0; x < nx; x++){
+    std::rotate(f+x*ny, f+x*ny+oy, f+(x+1)*ny);
+  }
+}
+
+template<typename E>
+ArrayOf<E> shift(const E &_field, const ArrayOf<E> &x, const ArrayOf<E> &y){
+  typedef typename E::value_type T;
+  const ArrayOf<E> field = _field;
+  //New Array (worker threads don't see the bound grid)
+  glm::vec2 modes = grid().modes;
+  Array<T> coef((T)0.0, grid().N);
   //Loop over the Field
+  #pragma omp parallel for num_threads(workers(field.size()))
   for(unsigned int i = 0; i < field.size(); i++){
-    glm::vec2 offset = glm::floor(glm::vec2(x[i].real(), y[i].real()));
-    int projected = (int)(ind(pos(i)+offset)+modes.x*modes.y)%(int)(modes.x*modes.y);
+    glm::vec2 offset = glm::floor(glm::vec2(std::real(x[i]), std::real(y[i])));
+    int projected = (int)(ind(pos(i, modes)+offset, modes)+modes.x*modes.y)%(int)(modes.x*modes.y);
     coef[i] = field[projected];
   }
   return coef;
 }
 
-CArray clamp(CArray field, double low, double high){
-  field[field > high] = (complex)high; //Clamp
-  field[field < low] = (complex)low;
+template<typename E>
+ArrayOf<E> clamp(const E &_field, double low, double high){
+  typedef typename E::value_type T;
+  ArrayOf<E> field = _field;
+  #pragma omp parallel for num_threads(workers(field.size()))
+  for(unsigned int i = 0; i < field.size(); i++){
+    if(field[i] > (T)high) field[i] = (T)high; //Clamp
+    if(field[i] < (T)low) field[i] = (T)low;
+  }
   return field;
 }
 
-CArray scale(CArray field, double min, double max){
+template<typename E>
+ArrayOf<E> scale(const E &_field, double min, double max){
+  typedef typename E::value_type T;
+  ArrayOf<E> field = _field;
   //Return a threshold
-  double fmax = field[0].real();
-  double fmin = field[0].real();
+  double fmax = std::real(field[0]);
+  double fmin = std::real(field[0]);
   //Get Maximum
+  #pragma omp parallel for num_threads(workers(field.size())) reduction(max:fmax) reduction(min:fmin)
   for(unsigned int i = 1; i < field.size(); i++){
-    if(field[i].real() > fmax){
-      fmax = field[i].real();
+    if(std::real(field[i]) > fmax){
+      fmax = std::real(field[i]);
     }
-    if(field[i].real() < fmin){
-      fmin = field[i].real();
+    if(std::real(field[i]) < fmin){
+      fmin = std::real(field[i]);
     }
   }
   //Rescale
+  #pragma omp parallel for num_threads(workers(field.size()))
   for(unsigned int i = 0; i < field.size(); i++){
-    field[i] = (field[i]-fmin)/(fmax-fmin)*(max-min)+min;
+    field[i] = (T)((field[i]-(T)fmin)/(T)(fmax-fmin)*(T)(max-min)+(T)min);
   }
   return field;
 }
 
-CArray abs(CArray field){
+template<typename E>
+ArrayOf<E> abs(const E &_field){
+  typedef typename E::value_type T;
+  ArrayOf<E> field = _field;
   //Absolute Value
+  #pragma omp parallel for num_threads(workers(field.size()))
   for(unsigned int i = 0; i < field.size(); i++){
-    field[i] = (field[i] < 0.0)?-1.0*field[i]:field[i];
+    field[i] = (std::real(field[i]) < 0.0)?(T)-1.0*field[i]:field[i];
   }
   return field;
 }
 
 
-//2D N-th order Differential in Fourier Space
-CArray fdiff(CArray field, int x, int y){
-  //Fill the Blank Field
+//2D N-th order Differential in Fourier Space (full or half-spectrum)
+CArray fdiff(CArray field, int x, int y, bool half){
+  const CArray& _d = derivative(x, y, half);
+  #pragma omp parallel for num_threads(workers(field.size()))
   for(unsigned int i = 0; i < field.size(); i++){
-    //Get the coefficient index
-    glm::vec2 z = solve::pos(i);
-    field[i] *= pow(1.0i*(2*PI*z.x), x)*pow(1.0i*(2*PI*z.y), y);
+    field[i] *= _d[i];
   }
   return field;
 }
 
 //2D N-th order Differential in Fourier Space
-CArray diff(CArray field, int x, int y){
+template<typename E>
+ArrayOf<E> diff(const E &field, int x, int y){
+  typedef typename E::value_type T;
   //Convert the Field
-  return ifft(fdiff(fft(field), x, y));
+  return backward<T>(fdiff(forward<T>(field), x, y, half<T>()));
+}
+
+//Diffusion in Fourier Space (full or half-spectrum)
+CArray fdiffuse(CArray _d, double mu, int cycles, bool half){
+  //All cycles at once, exactly
+  multiply(_d, diffusion(mu, cycles, half));
+  return _d;
+}
+
+//Laplacian in Fourier Space (full or half-spectrum)
+CArray flaplace(CArray coef, bool half){
+  multiply(coef, spectrum(half).laplacian);
+  return coef;
+}
+
+template<typename E>
+ArrayOf<E> diffuse(const E &field, double mu, int cycles){
+  typedef typename E::value_type T;
+  //Convert to fourier space and back
+  return backward<T>(fdiffuse(forward<T>(field), mu, cycles, half<T>()));
+}
+
+/*
+================================================================================
+                            Batched Term Helpers
+================================================================================
+*/
+
+template<typename T>
+std::vector<Array<T>> diff(const Span<T> &fields, int x, int y){
+  std::vector<CArray> coefs = forward<T>(fields);
+  for(unsigned int f = 0; f < coefs.size(); f++){
+    coefs[f] = fdiff(std::move(coefs[f]), x, y, half<T>());
+  }
+  return backward<T>(coefs);
+}
+
+template<typename T>
+void diffuse(const Span<T> &fields, double mu, int cycles){
+  std::vector<CArray> coefs = forward<T>(fields);
+  for(unsigned int f = 0; f < coefs.size(); f++){
+    multiply(coefs[f], diffusion(mu, cycles, half<T>()));
+  }
+  std::vector<Array<T>> _fields = backward<T>(coefs);
+  for(unsigned int f = 0; f < fields.size(); f++){
+    *fields[f] = _fields[f];
+  }
 }
 
-CArray diffuse(CArray field, double mu, int cycles){
-  //Convert to fourier space
-  CArray _d = fft(field);
+/*
+================================================================================
+                              FFT Plan Cache
+================================================================================
+*/
 
-  for(int i = 0; i < cycles; i++){
-    //Somehow Compute Diffuse
-    for(unsigned int i = 0; i < field.size(); i++){
-      //Get the coefficient index
-      glm::vec2 z = solve::pos(i);
-      _d[i] += (complex)mu*(_d[i]*pow(2.0i*(PI*z.x), 2) + _d[i]*pow(2.0i*(PI*z.y), 2));
+//Plans are measured once per grid and direction, then reused.
+//Measurements are kept as FFTW wisdom on disk, so later runs plan instantly.
+//The file is written once at exit (or with saveWisdom), never while stepping.
+std::string wisdom = "fftw.wisdom";
+bool wisdomLoaded = false;
+bool wisdomChanged = false;   //New measurements since the last save
+
+//Aligned Heap Buffers (no stack arrays, large grids are fine)
+template<typename T>
+T* allocate(int N){
+  size_t align = 64;
+  size_t bytes = ((N*sizeof(T)+align-1)/align)*align;
+  T* buf = (T*)aligned_alloc(align, bytes);
+  if(buf == NULL){
+    std::cout<<"Failed to allocate transform buffer."<<std::endl;
+  }
+  return buf;
+}
+
+Plan& plan(fftw_direction dir, bool real){
+  //Return the cached plan if the grid has one
+  Grid& _g = grid();
+  std::pair<int, bool> key(dir, real);
+  auto found = _g.plans.find(key);
+  if(found != _g.plans.end()){
+    return found->second;
+  }
+
+  //Planning and wisdom are shared between all threads
+  std::lock_guard<std::mutex> lock(planning);
+  int nx = _g.modes.x;
+  int ny = _g.modes.y;
+
+  //Threaded transforms need a one-time setup before the first plan
+  if(!fftwThreads){
+    fftwThreads = true;
+    if(fftw_threads_init() != 0){
+      std::cout<<"Failed to initialize FFTW threads."<<std::endl;
+      nthreads = 1;
     }
   }
 
-  return ifft(_d);
+  //First plan of this run, get the old measurements
+  if(!wisdomLoaded){
+    loadWisdom();
+    std::atexit([]{ saveWisdom(); });
+  }
+
+  //Measure a new plan on its own buffers
+  Plan _plan;
+  _plan.real = real;
+  _plan.N = nx*ny;
+  _plan.M = (real)?nx*(ny/2+1):nx*ny;
+  _plan.buf = allocate<fftw_complex>(_plan.M);
+  _plan.rbuf = NULL;
+  _plan.capacity = 1;
+
+  if(real){
+    //Out-of-place between the real grid and the half-spectrum
+    _plan.rbuf = allocate<fftw_real>(_plan.N);
+    if(dir == FFTW_REAL_TO_COMPLEX)
+      _plan.p = rfftw2d_create_plan_specific(nx, ny, dir, FFTW_MEASURE | FFTW_USE_WISDOM, _plan.rbuf, 1, (fftw_real*)_plan.buf, 1);
+    else
+      _plan.p = rfftw2d_create_plan_specific(nx, ny, dir, FFTW_MEASURE | FFTW_USE_WISDOM, (fftw_real*)_plan.buf, 1, _plan.rbuf, 1);
+  }
+  else _plan.p = fftw2d_create_plan_specific(nx, ny, dir, FFTW_MEASURE | FFTW_USE_WISDOM | FFTW_IN_PLACE, _plan.buf, 1, NULL, 1);
+
+  //Remember the measurement (written out later)
+  wisdomChanged = true;
+
+  return _g.plans[key] = _plan;
+}
+
+bool loadWisdom(){
+  wisdomLoaded = true;
+  FILE* file = fopen(wisdom.c_str(), "r");
+  if(file == NULL){
+    return false;
+  }
+  bool success = (fftw_import_wisdom_from_file(file) == FFTW_SUCCESS);
+  fclose(file);
+  return success;
+}
+
+bool saveWisdom(){
+  std::lock_guard<std::mutex> lock(planning);
+  if(!wisdomChanged){
+    return true;
+  }
+  FILE* file = fopen(wisdom.c_str(), "w");
+  if(file == NULL){
+    std::cout<<"Failed to write FFTW wisdom to "<<wisdom<<std::endl;
+    return false;
+  }
+  fftw_export_wisdom_to_file(file);
+  fclose(file);
+  wisdomChanged = false;
+  return true;
+}
+
+void clearPlans(){
+  grid().clear();
+}
+
+void reserve(Plan &_plan, int howmany){
+  if(howmany <= _plan.capacity){
+    return;
+  }
+  //Plans don't depend on the buffers, so we can simply swap them out
+  free(_plan.buf);
+  free(_plan.rbuf);
+  _plan.buf = allocate<fftw_complex>(howmany*_plan.M);
+  _plan.rbuf = (_plan.real)?allocate<fftw_real>(howmany*_plan.N):NULL;
+  _plan.capacity = howmany;
 }
 
 /*
@@ -275,134 +999,780 @@ CArray diffuse(CArray field, double mu, int cycles){
 */
 
 CArray fft(CArray coef){
-  int N = modes.x*modes.y;
-  fftw_complex x[N];
+  //std::complex<double> has the same layout as fftw_complex
+  Plan& _plan = plan(FFTW_FORWARD);
+  memcpy(_plan.buf, &coef[0], _plan.N*sizeof(fftw_complex));
 
-  //Copy from CArray
-  for(int i = 0; i < N; i++){
-    x[i].re = coef[i].real();
-    x[i].im = coef[i].imag();
-  }
   //Do the Transform
-  fftwnd_plan p = fftw2d_create_plan(modes.x, modes.y, FFTW_FORWARD, FFTW_ESTIMATE | FFTW_IN_PLACE);
-  fftwnd_one(p, x, NULL);
-  fftwnd_destroy_plan(p);
+  fftwnd_threads_one(workers(_plan.N), _plan.p, _plan.buf, NULL);
 
   //Convert Back
-  for(int i = 0; i < N; i++){
-    coef[i] = complex(x[i].re, x[i].im);
-  }
+  memcpy((void*)&coef[0], _plan.buf, _plan.N*sizeof(fftw_complex));
   return coef;
 }
 
 CArray ifft(CArray coef){
-  int N = modes.x*modes.y;
-  fftw_complex x[N];
+  //std::complex<double> has the same layout as fftw_complex
+  Plan& _plan = plan(FFTW_BACKWARD);
+  memcpy(_plan.buf, &coef[0], _plan.N*sizeof(fftw_complex));
 
-  //Copy from CArray
-  for(int i = 0; i < N; i++){
-    x[i].re = coef[i].real();
-    x[i].im = coef[i].imag();
-  }
   //Do the Transform
-  fftwnd_plan p = fftw2d_create_plan(modes.x, modes.y, FFTW_BACKWARD, FFTW_ESTIMATE | FFTW_IN_PLACE);
-  fftwnd_one(p, x, NULL);
-  fftwnd_destroy_plan(p);
+  fftwnd_threads_one(workers(_plan.N), _plan.p, _plan.buf, NULL);
 
-  //Convert Back
-  for(int i = 0; i < N; i++){
-    coef[i] = complex(x[i].re/N, x[i].im/N);
+  //Convert Back and Normalize
+  memcpy((void*)&coef[0], _plan.buf, _plan.N*sizeof(fftw_complex));
+  coef *= (complex)(1.0/_plan.N);
+  return coef;
+}
+
+template<typename T>
+CArray rfft(const Array<T> &field){
+  Plan& _plan = plan(FFTW_REAL_TO_COMPLEX, true);
+  #pragma omp parallel for num_threads(workers(_plan.N))
+  for(int i = 0; i < _plan.N; i++){
+    _plan.rbuf[i] = (fftw_real)field[i];
   }
+
+  //Do the Transform (only the non-redundant half)
+  rfftwnd_threads_one_real_to_complex(workers(_plan.N), _plan.p, _plan.rbuf, _plan.buf);
+
+  //Copy the Half-Spectrum
+  CArray coef(_plan.M);
+  memcpy((void*)&coef[0], _plan.buf, _plan.M*sizeof(fftw_complex));
   return coef;
 }
 
-CArray label(CArray field, int &nareas){
-  //Label Array
-  CArray _labels(0.0, modes.x*modes.y);
+/*
+================================================================================
+                        Batched Complex Operations
+================================================================================
+*/
 
-  //Centroid Vector
-  std::vector<complex> centroids;
+//Same-sized fields are packed into one buffer and transformed with a single
+//FFTW call, which shares the twiddle factors and keeps the cache warm.
 
-  //Loop over all Field Elements
-  for(unsigned int i = 0; i < field.size(); i++){
-    //Check if its inside the centroids
-    bool contained = false;
-
-    for(unsigned int j = 0; j < centroids.size(); j++){
-      //Check if we're inside the centroid
-      if(centroids[j] == field[i]){
-        //We have found the correct centroid
-        _labels[i] = (complex)j;
-        contained = true;
+std::vector<CArray> fft(const Span<complex> &fields){
+  int howmany = fields.size();
+  Plan& _plan = plan(FFTW_FORWARD);
+  reserve(_plan, howmany);
+  for(int f = 0; f < howmany; f++){
+    memcpy(_plan.buf+f*_plan.N, &(*fields[f])[0], _plan.N*sizeof(fftw_complex));
+  }
+
+  //Do the Transforms
+  fftwnd_threads(workers(_plan.N), _plan.p, howmany, _plan.buf, 1, _plan.N, NULL, 1, _plan.N);
+
+  //Convert Back
+  std::vector<CArray> coefs(howmany, CArray(_plan.N));
+  for(int f = 0; f < howmany; f++){
+    memcpy((void*)&coefs[f][0], _plan.buf+f*_plan.N, _plan.N*sizeof(fftw_complex));
+  }
+  return coefs;
+}
+
+std::vector<CArray> ifft(const std::vector<CArray> &coefs){
+  int howmany = coefs.size();
+  Plan& _plan = plan(FFTW_BACKWARD);
+  reserve(_plan, howmany);
+  for(int f = 0; f < howmany; f++){
+    memcpy(_plan.buf+f*_plan.N, &coefs[f][0], _plan.N*sizeof(fftw_complex));
+  }
+
+  //Do the Transforms
+  fftwnd_threads(workers(_plan.N), _plan.p, howmany, _plan.buf, 1, _plan.N, NULL, 1, _plan.N);
+
+  //Convert Back and Normalize
+  std::vector<CArray> fields(howmany, CArray(_plan.N));
+  for(int f = 0; f < howmany; f++){
+    memcpy((void*)&fields[f][0], _plan.buf+f*_plan.N, _plan.N*sizeof(fftw_complex));
+    fields[f] *= (complex)(1.0/_plan.N);
+  }
+  return fields;
+}
+
+template<typename T>
+std::vector<CArray> rfft(const Span<T> &fields){
+  int howmany = fields.size();
+  Plan& _plan = plan(FFTW_REAL_TO_COMPLEX, true);
+  reserve(_plan, howmany);
+  for(int f = 0; f < howmany; f++){
+    #pragma omp parallel for num_threads(workers(_plan.N))
+    for(int i = 0; i < _plan.N; i++){
+      _plan.rbuf[f*_plan.N+i] = (fftw_real)(*fields[f])[i];
+    }
+  }
+
+  //Do the Transforms
+  rfftwnd_threads_real_to_complex(workers(_plan.N), _plan.p, howmany, _plan.rbuf, 1, _plan.N, _plan.buf, 1, _plan.M);
+
+  //Copy the Half-Spectra
+  std::vector<CArray> coefs(howmany, CArray(_plan.M));
+  for(int f = 0; f < howmany; f++){
+    memcpy((void*)&coefs[f][0], _plan.buf+f*_plan.M, _plan.M*sizeof(fftw_complex));
+  }
+  return coefs;
+}
+
+template<typename T>
+std::vector<Array<T>> irfft(const std::vector<CArray> &coefs){
+  int howmany = coefs.size();
+  Plan& _plan = plan(FFTW_COMPLEX_TO_REAL, true);
+  reserve(_plan, howmany);
+  for(int f = 0; f < howmany; f++){
+    memcpy(_plan.buf+f*_plan.M, &coefs[f][0], _plan.M*sizeof(fftw_complex));
+  }
+
+  //Do the Transforms
+  rfftwnd_threads_complex_to_real(workers(_plan.N), _plan.p, howmany, _plan.buf, 1, _plan.M, _plan.rbuf, 1, _plan.N);
+
+  //Convert Back and Normalize
+  std::vector<Array<T>> fields(howmany, Array<T>(_plan.N));
+  for(int f = 0; f < howmany; f++){
+    #pragma omp parallel for num_threads(workers(_plan.N))
+    for(int i = 0; i < _plan.N; i++){
+      fields[f][i] = (T)(_plan.rbuf[f*_plan.N+i]/_plan.N);
+    }
+  }
+  return fields;
+}
+
+template<typename T>
+Array<T> irfft(CArray coef){
+  Plan& _plan = plan(FFTW_COMPLEX_TO_REAL, true);
+  memcpy(_plan.buf, &coef[0], _plan.M*sizeof(fftw_complex));
+
+  //Do the Transform (this destroys the buffer, which is fine)
+  rfftwnd_threads_one_complex_to_real(workers(_plan.N), _plan.p, _plan.buf, _plan.rbuf);
+
+  //Convert Back and Normalize
+  Array<T> field(_plan.N);
+  #pragma omp parallel for num_threads(workers(_plan.N))
+  for(int i = 0; i < _plan.N; i++){
+    field[i] = (T)(_plan.rbuf[i]/_plan.N);
+  }
+  return field;
+}
+
+/*
+================================================================================
+                            Connected Area Labeling
+================================================================================
+*/
+
+//Two pass union-find: every thread links the cells of its block of rows, then
+//the seams between the blocks are linked. The root of an area is always its
+//first cell, so areas are numbered in order of appearance.
+
+int findRoot(std::vector<int> &parent, int i){
+  while(parent[i] != i){
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+void unite(std::vector<int> &parent, int a, int b){
+  a = findRoot(parent, a);
+  b = findRoot(parent, b);
+  if(a < b) parent[b] = a;
+  if(b < a) parent[a] = b;
+}
+
+template<typename E>
+IArray components(const E &_field, std::vector<Component> &stats, int connectivity, bool periodic){
+  const ArrayOf<E> field = _field;
+  glm::vec2 modes = grid().modes;
+  const int nx = modes.x, ny = modes.y, N = nx*ny;
+
+  std::vector<int> parent(N);
+  for(int i = 0; i < N; i++){
+    parent[i] = i;
+  }
+
+  //Link two cells of equal value (b is left out if it's off the grid)
+  auto link = [&](int a, int x, int y){
+    if(x < 0 || x >= nx || y < 0 || y >= ny){
+      if(!periodic) return;
+      x = (x+nx)%nx;
+      y = (y+ny)%ny;
+    }
+    int b = x*ny+y;
+    if(a != b && equal(field[a], field[b])) unite(parent, a, b);
+  };
+
+  //Row x with the row before it
+  auto seam = [&](int x){
+    for(int y = 0; y < ny; y++){
+      link(x*ny+y, x-1, y);
+      if(connectivity == 8){
+        link(x*ny+y, x-1, y-1);
+        link(x*ny+y, x-1, y+1);
       }
     }
+  };
+
+  //Blocks of rows are independent
+  int nchunks = std::min(workers(N), nx);
+  #pragma omp parallel for num_threads(nchunks)
+  for(int c = 0; c < nchunks; c++){
+    for(int x = c*nx/nchunks; x < (c+1)*nx/nchunks; x++){
+      for(int y = 0; y < ny; y++){
+        link(x*ny+y, x, y-1);
+      }
+      if(x > c*nx/nchunks) seam(x);
+    }
+  }
+
+  //Seams between the blocks, and the wrap
+  for(int c = 1; c < nchunks; c++){
+    seam(c*nx/nchunks);
+  }
+  if(periodic && nx > 1){
+    seam(0);
+  }
+
+  //Roots are numbered in order
+  std::vector<int> root(N);
+  std::vector<int> count(nchunks+1, 0);
+  #pragma omp parallel for num_threads(nchunks)
+  for(int c = 0; c < nchunks; c++){
+    for(int i = c*N/nchunks; i < (c+1)*N/nchunks; i++){
+      int r = i;
+      while(parent[r] != r) r = parent[r];    //No path halving, others read too
+      root[i] = r;
+      if(r == i) count[c+1]++;
+    }
+  }
+  for(int c = 0; c < nchunks; c++){
+    count[c+1] += count[c];
+  }
+  int K = count[nchunks];
+  #pragma omp parallel for num_threads(nchunks)
+  for(int c = 0; c < nchunks; c++){
+    int n = count[c];
+    for(int i = c*N/nchunks; i < (c+1)*N/nchunks; i++){
+      if(root[i] == i) parent[i] = n++;       //Roots keep their number in parent
+    }
+  }
+
+  //Labels and statistics in one sweep (per-thread sums, unless that's too big)
+  struct Sum{
+    int area = 0;
+    double x = 0.0, y = 0.0;      //Sums of positions or of their angles
+    double cx = 0.0, sx = 0.0, cy = 0.0, sy = 0.0;
+    glm::vec2 lower = glm::vec2(1E9), upper = glm::vec2(-1E9);
+  };
+  int nsums = ((long)nchunks*K > 4L*N)?1:nchunks;
+  std::vector<std::vector<Sum>> sums(nsums, std::vector<Sum>(K));
+  IArray labels(N);
 
-    if(!contained){
-      //Add the centroid
-      centroids.push_back(field[i]);
+  //Positions on the circle, for the periodic centroid
+  const double wx = 2.0*PI/nx, wy = 2.0*PI/ny;
+  std::vector<double> cosx(nx), sinx(nx), cosy(ny), siny(ny);
+  for(int x = 0; x < nx; x++){ cosx[x] = cos(wx*x); sinx[x] = sin(wx*x); }
+  for(int y = 0; y < ny; y++){ cosy[y] = cos(wy*y); siny[y] = sin(wy*y); }
 
-      //Set our label to the current centroids size
-      _labels[i] = (complex)centroids.size();
+  #pragma omp parallel for num_threads(nsums)
+  for(int c = 0; c < nsums; c++){
+    std::vector<Sum> &_s = sums[c];
+    for(int i = c*N/nsums; i < (c+1)*N/nsums; i++){
+      int l = parent[root[i]];
+      labels[i] = l;
+      int x = i/ny, y = i-x*ny;
+      Sum &a = _s[l];
+      a.area++;
+      if(periodic){
+        a.cx += cosx[x]; a.sx += sinx[x];
+        a.cy += cosy[y]; a.sy += siny[y];
+      }
+      else{
+        a.x += x;
+        a.y += y;
+        a.lower = glm::min(a.lower, glm::vec2(x, y));
+        a.upper = glm::max(a.upper, glm::vec2(x, y));
+      }
+    }
+  }
+
+  //Merge the threads
+  stats.assign(K, Component());
+  for(int l = 0; l < K; l++){
+    Sum a;
+    for(int c = 0; c < nsums; c++){
+      const Sum &b = sums[c][l];
+      a.area += b.area;
+      a.x += b.x; a.y += b.y;
+      a.cx += b.cx; a.sx += b.sx; a.cy += b.cy; a.sy += b.sy;
+      a.lower = glm::min(a.lower, b.lower);
+      a.upper = glm::max(a.upper, b.upper);
+    }
+    Component &_c = stats[l];
+    _c.area = a.area;
+    _c.lower = a.lower;
+    _c.upper = a.upper;
+    if(periodic){
+      double ax = atan2(a.sx, a.cx)/wx;
+      double ay = atan2(a.sy, a.cy)/wy;
+      _c.centroid = glm::vec2(fmod(ax+nx, nx), fmod(ay+ny, ny));
     }
+    else _c.centroid = glm::vec2(a.x, a.y)/(float)a.area;
   }
 
-  nareas = centroids.size();
+  //On periodic grids, every cell counts at its copy closest to the centroid,
+  //so an area across the seam gets its own box and not one around the grid
+  if(periodic){
+    std::vector<std::vector<Sum>> bounds(nsums, std::vector<Sum>(K));
+    #pragma omp parallel for num_threads(nsums)
+    for(int c = 0; c < nsums; c++){
+      std::vector<Sum> &_s = bounds[c];
+      for(int i = c*N/nsums; i < (c+1)*N/nsums; i++){
+        int l = labels[i];
+        glm::vec2 p = glm::vec2(i/ny, i%ny);
+        p -= modes*glm::floor((p-stats[l].centroid)/modes+glm::vec2(0.5));
+        _s[l].lower = glm::min(_s[l].lower, p);
+        _s[l].upper = glm::max(_s[l].upper, p);
+      }
+    }
+    for(int l = 0; l < K; l++){
+      Component &_c = stats[l];
+      for(int c = 0; c < nsums; c++){
+        _c.lower = glm::min(_c.lower, bounds[c][l].lower);
+        _c.upper = glm::max(_c.upper, bounds[c][l].upper);
+      }
+    }
+  }
+  return labels;
+}
+
+template<typename E>
+ArrayOf<E> label(const E &_field, int &nareas){
+  typedef typename E::value_type T;
+  std::vector<Component> stats;
+  IArray labels = components(_field, stats);
+  nareas = stats.size();
+
+  Array<T> _labels(labels.size());
+  #pragma omp parallel for num_threads(workers(labels.size()))
+  for(unsigned int i = 0; i < labels.size(); i++){
+    _labels[i] = (T)labels[i];
+  }
   return _labels;
 }
 
-float autothresh(CArray height, float start, float fraction){
-  //Compute the Sealevel
-  float test = 0.0;
-  while((test - fraction)*(test - fraction) > 0.001){
-    //Compute land above and below sealevel
-    CArray above(0.0, modes.x*modes.y);
-    CArray below(0.0, modes.x*modes.y);
-    above[height > (double)start] = 1.0;
-    below[height < (double)start] = 1.0;
-    //Our Current Ratio is the amount of land above/below the sealevel
-    test = above.sum().real() / (above.sum().real() + below.sum().real());
+/*
+================================================================================
+                              Label Reductions
+================================================================================
+*/
+
+//Every thread reduces its chunk of the grid for all labels, then the chunks are
+//merged. Labels outside of [0, nlabels) are skipped.
+
+template<typename T>
+Array<T> Reduction<T>::mean(int field) const{
+  Array<T> m((T)0.0, count.size());
+  for(unsigned int l = 0; l < count.size(); l++){
+    if(count[l] > 0) m[l] = sum[field][l]/(T)count[l];
+  }
+  return m;
+}
+
+template<typename T>
+Reduction<T> reduceByLabel(const IArray &labels, int nlabels, const Span<T> &fields){
+  int N = labels.size();
+  int F = fields.size();
 
-    //Proportionally Increase the sealevel
-    float k = 0.0001;
-    start += (test-fraction)*k;   //Positive Constant Important
+  //Partial results for many labels would outweigh the grid
+  int nchunks = workers(N);
+  if((long)nchunks*nlabels*F > N) nchunks = 1;
 
-    //Make sure it remains in bounds
-    if(start < 0.0){
-      //The sealevel is out of bounds
-      std::cout<<"Threshold too low."<<std::endl;
-      return 0.0;
+  std::vector<Reduction<T>> partial(nchunks);
+  #pragma omp parallel for num_threads(nchunks)
+  for(int c = 0; c < nchunks; c++){
+    Reduction<T> &_r = partial[c];
+    _r.count.assign(nlabels, 0);
+    _r.sum.assign(F, Array<T>((T)0.0, nlabels));
+    _r.min.assign(F, Array<T>((T)0.0, nlabels));
+    _r.max.assign(F, Array<T>((T)0.0, nlabels));
+    for(int i = c*N/nchunks; i < (c+1)*N/nchunks; i++){
+      int l = labels[i];
+      if(l < 0 || l >= nlabels) continue;
+      bool first = (_r.count[l]++ == 0);
+      for(int f = 0; f < F; f++){
+        const T &v = (*fields[f])[i];
+        _r.sum[f][l] += v;
+        if(first || v < _r.min[f][l]) _r.min[f][l] = v;
+        if(first || _r.max[f][l] < v) _r.max[f][l] = v;
+      }
     }
-    if(start > 1.0){
-      //The sealevel is out of bounds
-      std::cout<<"Threshold too high."<<std::endl;
-      return 1.0;
+  }
+
+  //Merge the chunks in order
+  Reduction<T> result = std::move(partial[0]);
+  for(int c = 1; c < nchunks; c++){
+    const Reduction<T> &_r = partial[c];
+    for(int l = 0; l < nlabels; l++){
+      if(_r.count[l] == 0) continue;
+      bool first = (result.count[l] == 0);
+      result.count[l] += _r.count[l];
+      for(int f = 0; f < F; f++){
+        result.sum[f][l] += _r.sum[f][l];
+        if(first || _r.min[f][l] < result.min[f][l]) result.min[f][l] = _r.min[f][l];
+        if(first || result.max[f][l] < _r.max[f][l]) result.max[f][l] = _r.max[f][l];
+      }
     }
   }
-  return start;
+  return result;
 }
 
-CArray convolve(CArray field, CArray kernel, glm::vec2 ksize){
-  //Construct a padded kernel array
-  CArray padded(0.0, modes.x*modes.y);
+/*
+================================================================================
+                                Quantiles
+================================================================================
+*/
+
+//Exact order statistics in O(N): a histogram over the value range finds the
+//bin of every rank, then only the values in those bins are selected from.
+//Complex fields are ranked by their real part. The range is that of the
+//finite values, -inf and inf rank below and above them, NaN ranks last.
 
-  //Loop over the kernelsize
-  for(int k = 0; k < ksize.x; k++){
-    for(int l = 0; l < ksize.y; l++){
-      //Enter the Padded Stuff
-      padded[ind(glm::vec2(k, l)-glm::floor(ksize/glm::vec2(2)))] = kernel[ind(glm::vec2(k, l), ksize)];
+template<typename E>
+std::vector<double> ranked(const E &_field, const std::vector<long> &ranks){
+  const ArrayOf<E> field = _field;
+  long N = field.size();
+  std::vector<double> values(ranks.size(), 0.0);
+  if(N == 0) return values;
+
+  //Value Range (finite values only)
+  const double inf = std::numeric_limits<double>::infinity();
+  double fmin = inf;
+  double fmax = -inf;
+  long special = 0;
+  #pragma omp parallel for num_threads(workers(N)) reduction(max:fmax) reduction(min:fmin) reduction(+:special)
+  for(long i = 0; i < N; i++){
+    double v = std::real(field[i]);
+    if(!std::isfinite(v)){
+      special++;
+      continue;
+    }
+    if(v > fmax) fmax = v;
+    if(v < fmin) fmin = v;
+  }
+  if(fmin == fmax && special == 0){
+    std::fill(values.begin(), values.end(), fmin);
+    return values;
+  }
+
+  //Histogram (one per thread, then summed). Bin 0 holds -inf, bins 1 to B the
+  //finite values, then inf and NaN.
+  const int B = 4096;
+  const double scale = (fmax > fmin)?B/(fmax-fmin):0.0;
+  auto bin = [&](double v){
+    if(std::isnan(v)) return B+2;
+    if(v == -inf) return 0;
+    if(v == inf) return B+1;
+    return 1+std::min(B-1, (int)((v-fmin)*scale));
+  };
+  const double value[] = {-inf, inf, std::numeric_limits<double>::quiet_NaN()};   //Of the bins 0, B+1, B+2
+  int nchunks = workers(N);
+  std::vector<std::vector<long>> hist(nchunks, std::vector<long>(B+3, 0));
+  #pragma omp parallel for num_threads(nchunks)
+  for(int c = 0; c < nchunks; c++){
+    for(long i = c*N/nchunks; i < (c+1)*N/nchunks; i++){
+      hist[c][bin(std::real(field[i]))]++;
+    }
+  }
+  std::vector<long> first(B+4, 0);   //Rank of the first value in every bin
+  for(int b = 0; b < B+3; b++){
+    first[b+1] = first[b];
+    for(int c = 0; c < nchunks; c++) first[b+1] += hist[c][b];
+  }
+
+  //Bins that hold a requested rank (the values of the non-finite bins are known)
+  std::vector<int> bins(ranks.size());
+  std::vector<int> needed(B+3, -1);        //Bin to its slot in the candidate lists
+  int nneeded = 0;
+  for(unsigned int r = 0; r < ranks.size(); r++){
+    long k = std::min(std::max(ranks[r], 0L), N-1);
+    bins[r] = std::upper_bound(first.begin(), first.end(), k)-first.begin()-1;
+    if(bins[r] == 0 || bins[r] > B) continue;
+    if(needed[bins[r]] < 0) needed[bins[r]] = nneeded++;
+  }
+
+  //Collect their values
+  std::vector<std::vector<std::vector<double>>> found(nchunks, std::vector<std::vector<double>>(nneeded));
+  #pragma omp parallel for num_threads(nchunks)
+  for(int c = 0; c < nchunks; c++){
+    for(long i = c*N/nchunks; i < (c+1)*N/nchunks; i++){
+      double v = std::real(field[i]);
+      int slot = needed[bin(v)];
+      if(slot >= 0) found[c][slot].push_back(v);
+    }
+  }
+  std::vector<std::vector<double>> candidates(nneeded);
+  for(int c = 0; c < nchunks; c++){
+    for(int n = 0; n < nneeded; n++){
+      candidates[n].insert(candidates[n].end(), found[c][n].begin(), found[c][n].end());
     }
   }
 
-  //Return Convolution
-  return ifft(fft(padded)*fft(field));
+  //Select within the bin
+  for(unsigned int r = 0; r < ranks.size(); r++){
+    if(bins[r] == 0 || bins[r] > B){
+      values[r] = value[(bins[r] == 0)?0:bins[r]-B];
+      continue;
+    }
+    long k = std::min(std::max(ranks[r], 0L), N-1);
+    std::vector<double> &_c = candidates[needed[bins[r]]];
+    long offset = k-first[bins[r]];
+    std::nth_element(_c.begin(), _c.begin()+offset, _c.end());
+    values[r] = _c[offset];
+  }
+  return values;
 }
 
-CArray sample(CArray field, glm::vec2 oldSize, glm::vec2 newSize){
-  //Construct our output array
-  CArray coef(0.0, newSize.x*newSize.y);
-  return coef;
+template<typename E>
+std::vector<double> quantiles(const E &field, const std::vector<double> &q){
+  //Linear interpolation between the two nearest ranks
+  long N = field.size();
+  std::vector<long> ranks;
+  for(double _q: q){
+    double p = std::min(std::max(_q, 0.0), 1.0)*(N-1);
+    ranks.push_back((long)std::floor(p));
+    ranks.push_back((long)std::ceil(p));
+  }
+  std::vector<double> values = ranked(field, ranks);
+
+  std::vector<double> result(q.size());
+  for(unsigned int i = 0; i < q.size(); i++){
+    double p = std::min(std::max(q[i], 0.0), 1.0)*(N-1);
+    double t = p-std::floor(p);
+    result[i] = values[2*i]+t*(values[2*i+1]-values[2*i]);
+  }
+  return result;
+}
+
+//The start value of the old iterative search is not needed anymore
+template<typename E>
+float autothresh(const E &height, float, float fraction){
+  //Halfway between the highest cell below and the lowest cell above the level
+  long N = height.size();
+  long above = std::lround(std::min(std::max(fraction, 0.0f), 1.0f)*N);
+  if(above == 0) return ranked(height, {N-1})[0];
+  if(above == N) return ranked(height, {0})[0];
+  std::vector<double> v = ranked(height, {N-above-1, N-above});
+  return 0.5*(v[0]+v[1]);
+}
+
+/*
+================================================================================
+                                Resampling
+================================================================================
+*/
+
+Resampling resampling(int n, int m, Sampling method){
+  //Shrinking widens the filter by the scale, so every old point is averaged in
+  double scale = std::max(1.0, (double)n/m);
+  double radius = (method == BICUBIC)?2.0:1.0;
+  double R = radius*scale;
+
+  Resampling r;
+  if(method == NEAREST){
+    r.taps = 1;
+    r.weight.assign(m, 1.0);
+    for(int j = 0; j < m; j++){
+      r.index.push_back(std::lround((double)j*n/m)%n);
+    }
+    return r;
+  }
+
+  r.taps = std::ceil(2*R)+1;
+  r.index.resize(m*r.taps);
+  r.weight.resize(m*r.taps);
+  for(int j = 0; j < m; j++){
+    double center = (double)j*n/m;
+    int lo = std::floor(center-R)+1;
+    double sum = 0.0;
+    for(int t = 0; t < r.taps; t++){
+      double x = std::abs(lo+t-center)/scale;
+      double w = 0.0;
+      if(method == BILINEAR) w = std::max(0.0, 1.0-x);
+      else w = cubic(x);
+      r.index[j*r.taps+t] = ((lo+t)%n+n)%n;
+      r.weight[j*r.taps+t] = w;
+      sum += w;
+    }
+    for(int t = 0; t < r.taps; t++){
+      r.weight[j*r.taps+t] /= sum;
+    }
+  }
+  return r;
+}
+
+double cubic(double x){
+  x = std::abs(x);
+  if(x < 1.0) return (1.5*x-2.5)*x*x+1.0;
+  if(x < 2.0) return ((-0.5*x+2.5)*x-4.0)*x+2.0;
+  return 0.0;
+}
+
+std::vector<std::tuple<int, int, double>> refold(int n, int m){
+  //Modes both sizes share are copied, the rest is cut off (ideal low-pass)
+  std::vector<std::tuple<int, int, double>> modes;
+  for(int f = -(n-1)/2; f <= n/2; f++){
+    int k = (f+n)%n;
+    if(2*f == n && m > n){
+      //The old nyquist mode is both +n/2 and -n/2, split it to keep real fields real
+      modes.emplace_back(k, n/2, 0.5);
+      modes.emplace_back(k, m-n/2, 0.5);
+    }
+    else if(2*std::abs(f) < m) modes.emplace_back(k, (f+m)%m, 1.0);
+    else if(2*std::abs(f) == m) modes.emplace_back(k, m/2, 1.0);   //Both sides add up in the new nyquist mode
+  }
+  return modes;
+}
+
+template<typename E>
+ArrayOf<E> sample(const E &field, glm::vec2 oldSize, glm::vec2 newSize, Sampling method){
+  typedef typename E::value_type T;
+  const int nx = oldSize.x, ny = oldSize.y;
+  const int mx = newSize.x, my = newSize.y;
+
+  if(method == SPECTRAL){
+    //Zero-pad or truncate the spectrum, transformed on grids of the two sizes
+    CArray coef = toComplex<T>(field);
+    {
+      Grid &_g = samplers[{nx, ny}];
+      _g.resize(oldSize);
+      Scope scope(_g);
+      coef = fft(coef);
+    }
+
+    auto fx = refold(nx, mx);
+    auto fy = refold(ny, my);
+    CArray padded((complex)0.0, mx*my);
+    double norm = (double)(mx*my)/(nx*ny);
+    for(auto &a: fx){
+      for(auto &b: fy){
+        padded[std::get<1>(a)*my+std::get<1>(b)] += coef[std::get<0>(a)*ny+std::get<0>(b)]*(norm*std::get<2>(a)*std::get<2>(b));
+      }
+    }
+
+    Grid &_g = samplers[{mx, my}];
+    _g.resize(newSize);
+    Scope scope(_g);
+    return fromComplex<T>(ifft(padded));
+  }
+
+  //Separable: along y row by row, then along x adding up whole rows
+  Resampling rx = resampling(nx, mx, method);
+  Resampling ry = resampling(ny, my, method);
+  Array<T> rows(nx*my);
+  Array<T> out((T)0.0, mx*my);
+  #pragma omp parallel for num_threads(workers(nx*my))
+  for(int x = 0; x < nx; x++){
+    for(int j = 0; j < my; j++){
+      T v = (T)0.0;
+      for(int t = 0; t < ry.taps; t++){
+        v += (T)ry.weight[j*ry.taps+t]*field[x*ny+ry.index[j*ry.taps+t]];
+      }
+      rows[x*my+j] = v;
+    }
+  }
+
+  #pragma omp parallel for num_threads(workers(mx*my))
+  for(int i = 0; i < mx; i++){
+    T* o = &out[i*my];
+    for(int t = 0; t < rx.taps; t++){
+      const T w = (T)rx.weight[i*rx.taps+t];
+      const T* r = &rows[rx.index[i*rx.taps+t]*my];
+      for(int j = 0; j < my; j++) o[j] += w*r[j];
+    }
+  }
+  return out;
+}
+
+/*
+================================================================================
+                          Semi-Lagrangian Advection
+================================================================================
+*/
+
+template<typename E>
+Advection advection(const E &x, const E &y, Sampling method){
+  Advection plan;
+  advection(plan, x, y, method);
+  return plan;
+}
 
-  //For some reason, I can't get this to work right now.
+template<typename E>
+void advection(Advection &plan, const E &x, const E &y, Sampling method){
+  //Plans are large (taps per axis and cell), keeping one avoids the allocation
+  const int nx = grid().modes.x, ny = grid().modes.y;
+  const int N = nx*ny;
+  plan.taps = (method == BICUBIC)?4:2;
+  plan.x.resize(N*plan.taps);
+  plan.y.resize(N*plan.taps);
+  plan.wx.resize(N*plan.taps);
+  plan.wy.resize(N*plan.taps);
+
+  //Taps start one point before the departure cell for the cubic
+  const int first = (method == BICUBIC)?-1:0;
+  #pragma omp parallel for num_threads(workers(N))
+  for(int i = 0; i < nx; i++){
+    for(int j = 0; j < ny; j++){
+      const int n = i*ny+j;
+      double px = i+std::real(x[n]);
+      double py = j+std::real(y[n]);
+      double cx = std::floor(px), cy = std::floor(py);
+      double fx = px-cx, fy = py-cy;
+
+      //Wrap the first tap once, the others follow
+      int tx = (((int)cx+first)%nx+nx)%nx;
+      int ty = (((int)cy+first)%ny+ny)%ny;
+      const int k = n*plan.taps;
+      for(int t = 0; t < plan.taps; t++){
+        plan.x[k+t] = tx*ny;
+        plan.y[k+t] = ty;
+        if(++tx == nx) tx = 0;
+        if(++ty == ny) ty = 0;
+      }
+      if(method == BICUBIC){
+        for(int t = 0; t < 4; t++){
+          plan.wx[k+t] = cubic(fx+1-t);
+          plan.wy[k+t] = cubic(fy+1-t);
+        }
+      }
+      else{
+        plan.wx[k] = 1.0-fx;
+        plan.wx[k+1] = fx;
+        plan.wy[k] = 1.0-fy;
+        plan.wy[k+1] = fy;
+      }
+    }
+  }
+}
+
+template<typename E>
+ArrayOf<E> advect(const E &_field, const Advection &plan){
+  typedef typename E::value_type T;
+  const ArrayOf<E> &field = _field;
+  const int N = field.size();
+  Array<T> out(N);
+  #pragma omp parallel for num_threads(workers(N))
+  for(int i = 0; i < N; i++){
+    const int k = i*plan.taps;
+    T v = (T)0.0;
+    for(int a = 0; a < plan.taps; a++){
+      T row = (T)0.0;
+      for(int b = 0; b < plan.taps; b++){
+        row += (T)plan.wy[k+b]*field[plan.x[k+a]+plan.y[k+b]];
+      }
+      v += (T)plan.wx[k+a]*row;
+    }
+    out[i] = v;
+  }
+  return out;
 }
 
 //End of namespace
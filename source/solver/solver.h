@@ -1,39 +1,82 @@
 #include "solver.cpp"
+#include "field.h"
+#include "kernel.h"
+#include "multigrid.h"
 /*
 ================================================================================
                             PDE Solving Helper Class
 ================================================================================
 */
-template<typename Model>
+template<typename Model, typename Scalar = complex>
 class Solver{
 public:
+  //Field Storage (real Scalar types store real grids)
+  typedef std::vector<Array<Scalar>> Fields;
+  typedef void (Model::*Integrator)(Fields &fields, Fields &rhs);   //Edits the fields and / or writes their time derivative
+  typedef void (Solver::*Method)(Model &model, Integrator _call);  //Integration method (DIRECT, EE, RK2, RK3, RK4, DOPRI, IMEX, ETD)
+
   //Setup the Simulation
   std::string name;
-  std::vector<CArray> fields;
+  Fields fields;
+  Fields rhs;                //Time derivative buffers, reused every step
   //const char* field_names[] = {"Volcanism", "Plates", "Height"};
 
   //Settings
   void setup(std::string _name, glm::vec2 _dim, double _t);
   glm::vec2 dim;
+  solve::Grid grid;          //Size and caches the helpers use while this solver works
   bool updateFields = true;  //If the fields have been updated
   int steps = 0;             //Remaining Steps
   double timeStep = 0.01;    //Current Timestep
+  double time = 0.0;         //Simulated Time
+
+  //Adaptive Stepping (DOPRI)
+  double atol = 1E-6;        //Absolute and relative tolerance of the local error
+  double rtol = 1E-3;
+  int accepted = 0;          //Step counts
+  int rejected = 0;
+  bool failed = false;       //The last step could not meet the tolerances (fields and time unchanged)
+
+  //Linear Diffusion (IMEX, ETD): du/dt = mu*laplace(u) + rhs
+  std::vector<double> diffusivity;   //mu of every field (0: no linear term)
+  void setDiffusivity(int _field, double _mu);
+  solve::Boundary boundary = solve::PERIODIC;  //Non-periodic diffusion is solved with multigrid (IMEX only)
 
   //Grid Set Manipulators
   void addField(float a[]);
-  void addField(CArray a);
-  void appendFields(std::vector<CArray> a);
+  void addField(Array<Scalar> a);
+  void appendFields(Fields a);
 
   //Current Integrator Handle
-  std::vector<CArray>(Model::*integrator)(std::vector<CArray>&);
+  Integrator integrator;
+
+  //Master Integrators (this is called every tick to integrate a single step, false if a step failed)
+  bool step(Model &model, Method _inte);
+  bool integrate(Model &model, int _steps, Method _inte);
+  bool advance(Model &model, double _T, Method _inte = &Solver::DOPRI);    //Integrate until the time _T
 
-  //Master Integrators (this is called every tick to integrate a single step)
-  bool step(Model &model, std::vector<CArray> (Solver::*_inte)( Model &model, std::vector<CArray>(Model::*_call)(std::vector<CArray>&_fields)));
-  bool integrate(Model &model, int _steps, std::vector<CArray> (Solver::*_inte)( Model &model, std::vector<CArray>(Model::*_call)(std::vector<CArray>&_fields)));
+  //Step Integration Methods (update the fields in place)
+  void DIRECT(Model &model, Integrator _call);
+  void EE(Model &model, Integrator _call);
+  void RK2(Model &model, Integrator _call);   //Heun
+  void RK3(Model &model, Integrator _call);   //Strong stability preserving (Shu-Osher)
+  void RK4(Model &model, Integrator _call);   //Classic Runge-Kutta
+  void DOPRI(Model &model, Integrator _call); //Dormand-Prince 5(4), adapts the timeStep
+  void IMEX(Model &model, Integrator _call);  //Implicit diffusion, explicit rhs (1st order)
+  void ETD(Model &model, Integrator _call);   //Exact diffusion, exponential rhs (2nd order)
 
-  //Step Integration Methods
-  std::vector<CArray> DIRECT(Model &model, std::vector<CArray> (Model::*_call)( std::vector<CArray> &_fields ) );
-  std::vector<CArray> EE(Model &model, std::vector<CArray> (Model::*_call)( std::vector<CArray> &_fields ) );
+private:
+  void allocate();                            //Match the rhs buffers to the fields (only allocates when they change)
+  void allocate(int _stages);                 //Same, plus the intermediate state and additional stage buffers
+  void match(Fields &buffers);
+  void derivative(Model &model, Integrator _call, Fields &state, Fields &k);
+  std::vector<int> linear();                  //Fields with a diffusivity
+  solve::Multigrid<Scalar> multigrid;         //Keeps its levels between steps
+
+  Fields state;                 //Intermediate state of a multi-stage method
+  double initialStep = 0.01;    //timeStep of the setup, adaptive stepping restarts from it after a failure
+  bool warnedETD = false;       //The IMEX fallback of ETD is only reported once
+  std::vector<Fields> stages;   //Stage derivatives beyond rhs
 };
 
 /*
@@ -42,30 +85,89 @@ public:
 ================================================================================
 */
 
-template<typename Model>
-void Solver<Model>::setup(std::string _name, glm::vec2 _dim, double _t){
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::setup(std::string _name, glm::vec2 _dim, double _t){
   name = _name;
-  dim = dim;
+  dim = _dim;
+  grid.resize(dim);
   timeStep = _t;
+  initialStep = _t;
 }
 
-template<typename Model>
-void Solver<Model>::addField(CArray a){
-  //Make sure to set the modes!
-  solve::modes = dim;
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::addField(Array<Scalar> a){
+  //Make sure to set the grid!
+  grid.resize(dim);
+  solve::Scope scope(grid);
   fields.push_back(a);
 }
 
-template<typename Model>
-void Solver<Model>::addField(float a[]){
-  //Make sure to set the modes!
-  solve::modes = dim;
-  fields.push_back(solve::fromArray(a));
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::addField(float a[]){
+  //Make sure to set the grid!
+  grid.resize(dim);
+  solve::Scope scope(grid);
+  fields.push_back(solve::fromArray<Scalar>(a));
+}
+
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::match(Fields &buffers){
+  buffers.resize(fields.size());
+  for(unsigned int i = 0; i < fields.size(); i++){
+    if(buffers[i].size() != fields[i].size()){
+      buffers[i].resize(fields[i].size());
+    }
+  }
+}
+
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::allocate(){
+  match(rhs);
+}
+
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::allocate(int _stages){
+  //Multi-stage methods evaluate the rhs at intermediate states
+  match(rhs);
+  match(state);
+  if((int)stages.size() < _stages){
+    stages.resize(_stages);
+  }
+  for(int k = 0; k < _stages; k++){
+    match(stages[k]);
+  }
+}
+
+//Evaluate the time derivative of some state into k
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::derivative(Model &model, Integrator _call, Fields &_state, Fields &k){
+  for(unsigned int i = 0; i < k.size(); i++){
+    k[i] = (Scalar)0.0;
+  }
+  (model.*_call)(_state, k);
+}
+
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::setDiffusivity(int _field, double _mu){
+  if((int)diffusivity.size() <= _field){
+    diffusivity.resize(_field+1, 0.0);
+  }
+  diffusivity[_field] = _mu;
+}
+
+template<typename Model, typename Scalar>
+std::vector<int> Solver<Model, Scalar>::linear(){
+  std::vector<int> index;
+  for(unsigned int i = 0; i < fields.size() && i < diffusivity.size(); i++){
+    if(diffusivity[i] != 0.0) index.push_back(i);
+  }
+  return index;
 }
 
-template<typename Model>
-void Solver<Model>::appendFields(std::vector<CArray> a){
-  solve::modes = dim;
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::appendFields(Fields a){
+  grid.resize(dim);
+  solve::Scope scope(grid);
   for(unsigned int i = 0; i < a.size(); i++){
     fields.push_back(a[i]);
   }
@@ -79,24 +181,17 @@ void Solver<Model>::appendFields(std::vector<CArray> a){
 */
 
 //Perform a single step integration every time it is called. Keeps track of remaining steps.
-template<typename Model>
-bool Solver<Model>::step(Model &model, std::vector<CArray> (Solver::*_inte)( Model &model, std::vector<CArray> (Model::*_call)(std::vector<CArray> &_fields) )){
-  //Set the modes
-  solve::modes = dim;
+template<typename Model, typename Scalar>
+bool Solver<Model, Scalar>::step(Model &model, Method _inte){
+  //Bind the grid
+  grid.resize(dim);
+  solve::Scope scope(grid);
 
   //If we have any steps left, perform an integration step
+  failed = false;
   if(steps != 0){
-
-    //Get the Deltas
-    std::vector<CArray> deltas = (*this.*_inte)(model, this->integrator);
-
-    //Add the Deltas
-    for(unsigned int i = 0; i < fields.size(); i++){
-      //Add the Terms to the fields
-      fields[i] += deltas[i];
-    }
-
-
+    //Step the fields
+    (*this.*_inte)(model, this->integrator);
 
     //Subtract a step
     steps--;
@@ -105,33 +200,60 @@ bool Solver<Model>::step(Model &model, std::vector<CArray> (Solver::*_inte)( Mod
   //Fields have been update
   updateFields = true;
 
-  //Really, everything should be converted into the fourier space here...
-  return true;
+  //Spectral work can stay in fourier space inside the integrator (solve::Field)
+  return !failed;
 }
 
 //Perform n-steps AT ONCE
-template<typename Model>
-bool Solver<Model>::integrate(Model &model, int _steps, std::vector<CArray> (Solver::*_inte)( Model &model, std::vector<CArray>(Model::*_call)(std::vector<CArray>&_fields))){
-  //Set the modes
-  solve::modes = dim;
+template<typename Model, typename Scalar>
+bool Solver<Model, Scalar>::integrate(Model &model, int _steps, Method _inte){
+  //Bind the grid
+  grid.resize(dim);
+  solve::Scope scope(grid);
 
   //If we have any steps left, perform an integration step
-  for(int j = 0; j < _steps; j++){
-    //Get the Deltas
-    std::vector<CArray> deltas = (*this.*_inte)(model, this->integrator);
+  failed = false;
+  for(int j = 0; j < _steps && !failed; j++){
+    //Step the fields
+    (*this.*_inte)(model, this->integrator);
+  }
 
-    //Add the Deltas
-    for(unsigned int i = 0; i < fields.size(); i++){
-      //Add the Terms to the fields
-      fields[i] += deltas[i];
+  //Fields have been update
+  updateFields = true;
+
+  //Spectral work can stay in fourier space inside the integrator (solve::Field)
+  return !failed;
+}
+
+//Perform steps until the simulated time reaches _T
+template<typename Model, typename Scalar>
+bool Solver<Model, Scalar>::advance(Model &model, double _T, Method _inte){
+  //Bind the grid
+  grid.resize(dim);
+  solve::Scope scope(grid);
+
+  //Don't overshoot, the last step is shortened
+  const double eps = 1E-12*std::max(1.0, std::abs(_T));
+  while(_T - time > eps){
+    double proposed = timeStep;
+    bool last = (time + timeStep >= _T);
+    if(last){
+      timeStep = _T - time;
+    }
+
+    failed = false;
+    (*this.*_inte)(model, this->integrator);
+
+    //The short step says nothing about the step size
+    if(!failed && last && _T - time <= eps){
+      timeStep = proposed;
     }
+    if(failed) break;
   }
 
   //Fields have been update
   updateFields = true;
-
-  //Really, everything should be converted into the fourier space here...
-  return true;
+  return !failed;
 }
 
 
@@ -142,18 +264,334 @@ bool Solver<Model>::integrate(Model &model, int _steps, std::vector<CArray> (Sol
 */
 
 //Explicit Euler Integrator
-template<typename Model>
-std::vector<CArray> Solver<Model>::EE(Model &model, std::vector<CArray> (Model::*_call)( std::vector<CArray> &_fields ) ){
-  //Get the Lambdas
-  std::vector<CArray> lambdas = (model.*_call)(fields);
-  std::for_each(lambdas.begin(), lambdas.end(), [this](CArray &l){ l = (complex)timeStep*l;});
-  return lambdas;
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::EE(Model &model, Integrator _call){
+  //Get the Time Derivative
+  allocate();
+  derivative(model, _call, fields, rhs);
+
+  //Add it in place
+  for(unsigned int i = 0; i < fields.size(); i++){
+    Array<Scalar> &f = fields[i];
+    const Array<Scalar> &r = rhs[i];
+    #pragma omp parallel for num_threads(solve::workers(f.size()))
+    for(unsigned int j = 0; j < f.size(); j++){
+      f[j] += (Scalar)timeStep*r[j];
+    }
+  }
+  time += timeStep;
 }
 
-//Explicit Euler Integrator
-template<typename Model>
-std::vector<CArray> Solver<Model>::DIRECT(Model &model, std::vector<CArray> (Model::*_call)( std::vector<CArray> &_fields ) ){
-  //Get the Lambdas
-  std::vector<CArray> lambdas = (model.*_call)(fields);
-  return lambdas;
+//Multi-stage methods call the integrator with intermediate states as well, so
+//it should only write the time derivative and leave the fields as they are.
+
+//Second Order Runge-Kutta (Heun)
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::RK2(Model &model, Integrator _call){
+  allocate(1);
+  const Scalar dt = (Scalar)timeStep;
+  const Scalar half = (Scalar)(0.5*timeStep);
+  Fields &k1 = rhs;
+  Fields &k2 = stages[0];
+
+  derivative(model, _call, fields, k1);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    state[i] = fields[i] + dt*k1[i];
+  }
+  derivative(model, _call, state, k2);
+
+  for(unsigned int i = 0; i < fields.size(); i++){
+    fields[i] += half*(k1[i] + k2[i]);
+  }
+  time += timeStep;
+}
+
+//Third Order Strong Stability Preserving Runge-Kutta
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::RK3(Model &model, Integrator _call){
+  allocate(0);
+  const Scalar dt = (Scalar)timeStep;
+  Fields &k = rhs;
+
+  //Euler step, averaged with the state twice
+  derivative(model, _call, fields, k);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    state[i] = fields[i] + dt*k[i];
+  }
+  derivative(model, _call, state, k);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    state[i] = (Scalar)0.75*fields[i] + (Scalar)0.25*(state[i] + dt*k[i]);
+  }
+  derivative(model, _call, state, k);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    fields[i] = (Scalar)(1.0/3.0)*fields[i] + (Scalar)(2.0/3.0)*(state[i] + dt*k[i]);
+  }
+  time += timeStep;
 }
+
+//Fourth Order Runge-Kutta
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::RK4(Model &model, Integrator _call){
+  allocate(3);
+  const Scalar dt = (Scalar)timeStep;
+  const Scalar half = (Scalar)(0.5*timeStep);
+  Fields &k1 = rhs;
+  Fields &k2 = stages[0];
+  Fields &k3 = stages[1];
+  Fields &k4 = stages[2];
+
+  derivative(model, _call, fields, k1);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    state[i] = fields[i] + half*k1[i];
+  }
+  derivative(model, _call, state, k2);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    state[i] = fields[i] + half*k2[i];
+  }
+  derivative(model, _call, state, k3);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    state[i] = fields[i] + dt*k3[i];
+  }
+  derivative(model, _call, state, k4);
+
+  for(unsigned int i = 0; i < fields.size(); i++){
+    fields[i] += (Scalar)(timeStep/6.0)*(k1[i] + (Scalar)2.0*(k2[i] + k3[i]) + k4[i]);
+  }
+  time += timeStep;
+}
+
+//Dormand-Prince Runge-Kutta 5(4)
+//One accepted step per call. The difference to the embedded 4th order solution
+//estimates the local error, which sets the size of the next step.
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::DOPRI(Model &model, Integrator _call){
+  allocate(6);
+  Fields &k1 = rhs;
+  Fields &k2 = stages[0];
+  Fields &k3 = stages[1];
+  Fields &k4 = stages[2];
+  Fields &k5 = stages[3];
+  Fields &k6 = stages[4];
+  Fields &k7 = stages[5];
+
+  //The last stage is not reused as the first one (FSAL), the fields
+  //might have been changed between two calls.
+  derivative(model, _call, fields, k1);
+
+  while(true){
+    const double h = timeStep;
+
+    for(unsigned int i = 0; i < fields.size(); i++){
+      state[i] = fields[i] + (Scalar)(h/5.0)*k1[i];
+    }
+    derivative(model, _call, state, k2);
+    for(unsigned int i = 0; i < fields.size(); i++){
+      state[i] = fields[i] + (Scalar)(h*3.0/40.0)*k1[i] + (Scalar)(h*9.0/40.0)*k2[i];
+    }
+    derivative(model, _call, state, k3);
+    for(unsigned int i = 0; i < fields.size(); i++){
+      state[i] = fields[i] + (Scalar)(h*44.0/45.0)*k1[i] + (Scalar)(h*-56.0/15.0)*k2[i] + (Scalar)(h*32.0/9.0)*k3[i];
+    }
+    derivative(model, _call, state, k4);
+    for(unsigned int i = 0; i < fields.size(); i++){
+      state[i] = fields[i] + (Scalar)(h*19372.0/6561.0)*k1[i] + (Scalar)(h*-25360.0/2187.0)*k2[i] + (Scalar)(h*64448.0/6561.0)*k3[i] + (Scalar)(h*-212.0/729.0)*k4[i];
+    }
+    derivative(model, _call, state, k5);
+    for(unsigned int i = 0; i < fields.size(); i++){
+      state[i] = fields[i] + (Scalar)(h*9017.0/3168.0)*k1[i] + (Scalar)(h*-355.0/33.0)*k2[i] + (Scalar)(h*46732.0/5247.0)*k3[i] + (Scalar)(h*49.0/176.0)*k4[i] + (Scalar)(h*-5103.0/18656.0)*k5[i];
+    }
+    derivative(model, _call, state, k6);
+
+    //5th Order Solution
+    for(unsigned int i = 0; i < fields.size(); i++){
+      state[i] = fields[i] + (Scalar)(h*35.0/384.0)*k1[i] + (Scalar)(h*500.0/1113.0)*k3[i] + (Scalar)(h*125.0/192.0)*k4[i] + (Scalar)(h*-2187.0/6784.0)*k5[i] + (Scalar)(h*11.0/84.0)*k6[i];
+    }
+    derivative(model, _call, state, k7);
+
+    //Error norm (root mean square, scaled by the tolerances)
+    double err = 0.0;
+    size_t n = 0;
+    for(unsigned int i = 0; i < fields.size(); i++){
+      const Array<Scalar> &y0 = fields[i];
+      const Array<Scalar> &y1 = state[i];
+      #pragma omp parallel for reduction(+:err) num_threads(solve::workers(y0.size()))
+      for(unsigned int j = 0; j < y0.size(); j++){
+        Scalar e = (Scalar)(h*71.0/57600.0)*k1[i][j] + (Scalar)(h*-71.0/16695.0)*k3[i][j] + (Scalar)(h*71.0/1920.0)*k4[i][j]
+                 + (Scalar)(h*-17253.0/339200.0)*k5[i][j] + (Scalar)(h*22.0/525.0)*k6[i][j] + (Scalar)(h*-1.0/40.0)*k7[i][j];
+        double sc = atol + rtol*std::max(std::abs(y0[j]), std::abs(y1[j]));
+        double r = std::abs(e)/sc;
+        err += r*r;
+      }
+      n += y0.size();
+    }
+    err = (n > 0)?std::sqrt(err/n):0.0;
+
+    //Next step size (bounded growth and shrinkage, NaN or inf shrink the most)
+    double factor = (err > 0.0)?0.9*std::pow(err, -0.2):5.0;
+    factor = std::min(5.0, std::max(0.2, factor));
+    if(!std::isfinite(err)) factor = 0.2;
+
+    //Accept the step
+    if(err <= 1.0){
+      for(unsigned int i = 0; i < fields.size(); i++){
+        fields[i] = state[i];
+      }
+      time += h;
+      timeStep = h*factor;
+      accepted++;
+      return;
+    }
+
+    //Reject and retry with a smaller step
+    rejected++;
+    timeStep = h*std::min(1.0, factor);
+    if(timeStep <= 1E-12*std::max(1.0, std::abs(time))){
+      //Keep the last good fields, the next call starts over from the initial step
+      std::cout<<"Step size underflow in "<<name<<", error tolerances can't be met."<<std::endl;
+      timeStep = initialStep;
+      failed = true;
+      return;
+    }
+  }
+}
+
+//The diffusion of the fields is applied in fourier space by the next two methods,
+//so it has no stability limit. The integrator only writes the remaining terms,
+//fields without a diffusivity are stepped explicitly.
+
+//Implicit-Explicit Euler
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::IMEX(Model &model, Integrator _call){
+  allocate();
+  derivative(model, _call, fields, rhs);
+  const double dt = timeStep;
+  const bool half = solve::half<Scalar>();
+
+  std::vector<int> index = linear();
+  for(unsigned int i = 0, j = 0; i < fields.size(); i++){
+    if(j < index.size() && index[j] == (int)i){
+      j++;
+      continue;
+    }
+    fields[i] += (Scalar)dt*rhs[i];
+  }
+  if(index.empty()){
+    time += dt;
+    return;
+  }
+
+  //(1 - dt*mu*laplace) u' = u + dt*rhs, starting from u
+  if(boundary != solve::PERIODIC){
+    multigrid.boundary = boundary;
+    multigrid.alpha = 1.0;
+    for(int i: index){
+      multigrid.beta = diffusivity[i]*dt;
+      rhs[i] = fields[i] + (Scalar)dt*rhs[i];
+      multigrid.solve(fields[i], rhs[i]);
+    }
+    time += dt;
+    return;
+  }
+
+  //Transform the fields and their rhs together
+  const int m = index.size();
+  Span<Scalar> batch;
+  for(int i: index) batch.push_back(&fields[i]);
+  for(int i: index) batch.push_back(&rhs[i]);
+  std::vector<CArray> coefs = solve::forward<Scalar>(batch);
+
+  //(1 + dt*mu*k²) u' = u + dt*rhs
+  for(int j = 0; j < m; j++){
+    coefs[j] += (complex)dt*coefs[m+j];
+    solve::multiply(coefs[j], solve::implicit(diffusivity[index[j]]*dt, half));
+  }
+  coefs.resize(m);
+
+  std::vector<Array<Scalar>> result = solve::backward<Scalar>(coefs);
+  for(int j = 0; j < m; j++){
+    fields[index[j]] = std::move(result[j]);
+  }
+  time += dt;
+}
+
+//Exponential Time Differencing Runge-Kutta (Cox-Matthews ETDRK2)
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::ETD(Model &model, Integrator _call){
+  allocate(1);
+  Fields &k1 = rhs;
+  Fields &k2 = stages[0];
+  const double dt = timeStep;
+  const bool half = solve::half<Scalar>();
+  std::vector<int> index = linear();
+  const int m = index.size();
+
+  //The exponential is only known for the periodic grid
+  if(boundary != solve::PERIODIC && m > 0){
+    if(!warnedETD) std::cout<<"ETD needs periodic boundaries, stepping "<<name<<" with IMEX."<<std::endl;
+    warnedETD = true;
+    IMEX(model, _call);
+    return;
+  }
+
+  //Predictor: a = e^(dt*L) u + dt*phi_1 N(u)
+  derivative(model, _call, fields, k1);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    state[i] = fields[i] + (Scalar)dt*k1[i];   //Replaced below if the field is linear
+  }
+
+  Span<Scalar> batch;
+  std::vector<CArray> coefs, predicted(m);
+  if(m > 0){
+    for(int i: index) batch.push_back(&fields[i]);
+    for(int i: index) batch.push_back(&k1[i]);
+    coefs = solve::forward<Scalar>(batch);
+    for(int j = 0; j < m; j++){
+      double rate = diffusivity[index[j]]*dt;
+      const RArray &E = solve::diffusion(rate, 1, half);
+      const RArray &P = solve::phi(1, rate, half);
+      predicted[j] = std::move(coefs[j]);
+      predicted[j] = E*predicted[j] + dt*P*coefs[m+j];
+    }
+    std::vector<Array<Scalar>> result = solve::backward<Scalar>(predicted);
+    for(int j = 0; j < m; j++){
+      state[index[j]] = std::move(result[j]);
+    }
+  }
+
+  //Corrector: u' = a + dt*phi_2 (N(a) - N(u))
+  derivative(model, _call, state, k2);
+  for(unsigned int i = 0; i < fields.size(); i++){
+    fields[i] = state[i] + (Scalar)(0.5*dt)*(k2[i] - k1[i]);   //Heun without diffusion
+  }
+  if(m == 0){
+    time += dt;
+    return;
+  }
+
+  batch.clear();
+  for(int i: index) batch.push_back(&k2[i]);
+  std::vector<CArray> corrections = solve::forward<Scalar>(batch);
+  for(int j = 0; j < m; j++){
+    const RArray &P = solve::phi(2, diffusivity[index[j]]*dt, half);
+    predicted[j] += dt*P*(corrections[j] - coefs[m+j]);
+  }
+  std::vector<Array<Scalar>> result = solve::backward<Scalar>(predicted);
+  for(int j = 0; j < m; j++){
+    fields[index[j]] = std::move(result[j]);
+  }
+  time += dt;
+}
+
+//Direct Integrator (the integrator edits the fields, nothing to add)
+template<typename Model, typename Scalar>
+void Solver<Model, Scalar>::DIRECT(Model &model, Integrator _call){
+  allocate();
+  (model.*_call)(fields, rhs);
+  time += timeStep;
+}
+
+//Coupled solvers (needs the Solver class)
+#include "scheduler.h"
+
+//Coarse-to-fine levels (needs the Solver class)
+#include "pipeline.h"